@@ -0,0 +1,67 @@
+/* Generates a synthetic but valid Bilby program for measuring how compile time scales with program size.
+
+   bilby-generate --functions=<n> [--density=<calls per function>] [--externs=<n>] [--seed=<n>]
+
+   Each function calls `density` functions on average, chosen uniformly among those defined before it, plus
+   occasional extern functions. The program is written to standard output. */
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include "cli-options.hpp"
+
+int main(int argc, char *argv[]) {
+	using namespace CliOptions;
+	auto options = parse(argc, argv);
+	auto numberOption = [&](std::string key, double fallback) -> double {
+		auto option = option_get(options, key);
+		return option.valid ? std::stod(option.value) : fallback;
+	};
+	std::size_t functions = numberOption("functions", 1000);
+	double density = numberOption("density", 2);
+	std::size_t externs = numberOption("externs", 16);
+	std::mt19937_64 random(numberOption("seed", 1));
+	if (functions == 0) {
+		std::cerr << "--functions must be at least 1." << std::endl;
+		return 1;
+	}
+
+	std::cout << "(extern (defun putchar (value::ui32)::ui32))\n";
+	for (std::size_t i = 0; i < externs; i++) {
+		std::cout << "(extern (defun ext" << i << " (a::ui32 b::ui32)::ui32))\n";
+	}
+
+	// Poisson call counts average to `density` while still varying from function to function.
+	std::poisson_distribution<std::size_t> callCount(density);
+	std::uniform_int_distribution<int> percent(0, 99);
+	for (std::size_t i = 0; i < functions; i++) {
+		std::cout << "(defun f" << i << " (a::ui32 b::ui32)::ui32\n";
+		std::cout << "  (let ((x (+ a (* b " << (i % 97) + 1 << "))))\n";
+		std::size_t calls = (i == 0) ? 0 : callCount(random);
+		for (std::size_t call = 0; call < calls; call++) {
+			std::string callee;
+			if ((externs > 0) && (percent(random) < 10)) {
+				callee = "ext" + std::to_string(std::uniform_int_distribution<std::size_t>(0, externs - 1)(random));
+			}
+			else {
+				callee = "f" + std::to_string(std::uniform_int_distribution<std::size_t>(0, i - 1)(random));
+			}
+			if (percent(random) < 25) {
+				std::cout << "    (if (> x " << percent(random) << ") (set x (+ x (" << callee << " x b))))\n";
+			}
+			else {
+				std::cout << "    (set x (- (" << callee << " x a) b))\n";
+			}
+		}
+		if (percent(random) < 10) {
+			std::cout << "    (for (i::ui32 0 b) (set x (+ x (* i a))))\n";
+		}
+		std::cout << "    x))\n";
+	}
+	std::cout << "(defun main ()::ui32\n";
+	std::cout << "  (putchar (f" << functions - 1 << " 1 2))\n";
+	std::cout << "  0)\n";
+	return 0;
+}
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Measures how the whole compile pipeline scales with program size.
+#
+# bench/scale.sh <build directory> [function counts...]
+#
+# DENSITY (calls per function) and EXTERNS (number of extern declarations) are taken from the environment. Time per
+# function that grows with program size points at superlinear behavior.
+
+set -e
+
+build=${1:?usage: bench/scale.sh <build directory> [function counts...]}
+shift
+sizes=${*:-1000 10000 100000}
+density=${DENSITY:-2}
+externs=${EXTERNS:-16}
+bilby=$(realpath "$build/src/bilby")
+generate=$(realpath "$build/bench/bilby-generate")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+printf '%10s %12s %9s %9s %9s %9s %9s %12s %12s %10s %10s\n' \
+       functions source-bytes parse lower optimize emit total ir-lowered ir-optimized rss-mb us/defun
+for size in $sizes; do
+	"$generate" --functions="$size" --density="$density" --externs="$externs" > "$work/program.bil"
+	(cd "$work" && "$bilby" --quiet --stats -f"$work/program.bil") > "$work/stats.txt"
+	awk -v size="$size" '
+		{ stat[$1] = $2 }
+		END {
+			printf "%10d %12d %9.3f %9.3f %9.3f %9.3f %9.3f %12d %12d %10.1f %10.2f\n",
+			       size, stat["source-bytes"], stat["time-parse"], stat["time-lower"], stat["time-optimize"],
+			       stat["time-emit"], stat["time-total"], stat["instructions-lowered"],
+			       stat["instructions-optimized"], stat["peak-rss-kb"] / 1024, stat["time-total"] * 1e6 / size
+		}' "$work/stats.txt"
+done
@@ -0,0 +1,109 @@
+/* Slow paths of the region and pool allocators. Allocation fast paths are inlined by the compiler. */
+
+#include "bilby-runtime.h"
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct bilby_arena_block {
+	struct bilby_arena_block *next;
+	alignas(max_align_t) char data[];
+};
+
+/* Objects follow the header, starting at the pool's alignment. */
+struct bilby_pool_block {
+	struct bilby_pool_block *next;
+};
+
+static void *allocateOrDie(size_t size) {
+	void *memory = malloc(size);
+	if (memory == NULL) {
+		fprintf(stderr, "bilby-runtime: Out of memory.\n");
+		abort();
+	}
+	return memory;
+}
+
+static void arenaPushBlock(struct bilby_arena *arena, size_t size) {
+	struct bilby_arena_block *block = allocateOrDie(sizeof(struct bilby_arena_block) + size);
+	block->next = arena->blocks;
+	arena->blocks = block;
+	arena->cursor = block->data;
+	arena->end = block->data + size;
+}
+
+struct bilby_arena *bilby_arena_create(size_t block_size) {
+	struct bilby_arena *arena = allocateOrDie(sizeof(struct bilby_arena));
+	arena->blocks = NULL;
+	arena->block_size = (block_size == 0) ? 4096 : block_size;
+	arenaPushBlock(arena, arena->block_size);
+	return arena;
+}
+
+/* Called when the current block can not hold the allocation. Oversized allocations get a block of their own. */
+void *bilby_arena_grow(struct bilby_arena *arena, size_t size, size_t alignment) {
+	size_t needed = size + alignment - 1;
+	arenaPushBlock(arena, (needed > arena->block_size) ? needed : arena->block_size);
+	uintptr_t cursor = (uintptr_t) arena->cursor;
+	char *aligned = arena->cursor + (((cursor + alignment - 1) & ~(uintptr_t) (alignment - 1)) - cursor);
+	arena->cursor = aligned + size;
+	return aligned;
+}
+
+/* Frees everything allocated from the arena. The oldest block is kept for reuse. */
+void bilby_arena_reset(struct bilby_arena *arena) {
+	while (arena->blocks->next != NULL) {
+		struct bilby_arena_block *next = arena->blocks->next;
+		free(arena->blocks);
+		arena->blocks = next;
+	}
+	arena->cursor = arena->blocks->data;
+	arena->end = arena->blocks->data + arena->block_size;
+}
+
+void bilby_arena_destroy(struct bilby_arena *arena) {
+	while (arena->blocks != NULL) {
+		struct bilby_arena_block *next = arena->blocks->next;
+		free(arena->blocks);
+		arena->blocks = next;
+	}
+	free(arena);
+}
+
+struct bilby_pool *bilby_pool_create(size_t object_size, size_t alignment, size_t block_count) {
+	struct bilby_pool *pool = allocateOrDie(sizeof(struct bilby_pool));
+	/* Free objects hold a pointer, and every object must stay aligned. */
+	pool->alignment = (alignment < alignof(void *)) ? alignof(void *) : alignment;
+	object_size = (object_size < sizeof(void *)) ? sizeof(void *) : object_size;
+	pool->object_size = (object_size + pool->alignment - 1) & ~(pool->alignment - 1);
+	pool->block_count = (block_count == 0) ? 64 : block_count;
+	pool->free = NULL;
+	pool->blocks = NULL;
+	return pool;
+}
+
+/* Called when the free list is empty. Threads a new block onto the free list and returns its first object. */
+void *bilby_pool_grow(struct bilby_pool *pool) {
+	struct bilby_pool_block *block = allocateOrDie(sizeof(struct bilby_pool_block) + pool->alignment
+	                                               + (pool->object_size * pool->block_count));
+	block->next = pool->blocks;
+	pool->blocks = block;
+	uintptr_t start = (uintptr_t) (block + 1);
+	char *data = (char *) (block + 1) + (((start + pool->alignment - 1) & ~(uintptr_t) (pool->alignment - 1)) - start);
+	for (size_t i = 1; i < pool->block_count; i++) {
+		void **object = (void **) (data + (i * pool->object_size));
+		*object = (i + 1 < pool->block_count) ? data + ((i + 1) * pool->object_size) : pool->free;
+	}
+	pool->free = (pool->block_count > 1) ? data + pool->object_size : pool->free;
+	return data;
+}
+
+void bilby_pool_destroy(struct bilby_pool *pool) {
+	while (pool->blocks != NULL) {
+		struct bilby_pool_block *next = pool->blocks->next;
+		free(pool->blocks);
+		pool->blocks = next;
+	}
+	free(pool);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+/* Data structures shared between the runtime and compiled code. The compiler inlines the fast paths of allocation,
+   so the leading fields of these structs are part of the ABI and must match the types built in the backend. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct bilby_arena_block;
+
+struct bilby_arena {
+	/* Next free byte and end of the current block. Read and written by inlined allocations. */
+	char *cursor;
+	char *end;
+	/* Runtime-only fields. */
+	struct bilby_arena_block *blocks;
+	size_t block_size;
+};
+
+struct bilby_pool_block;
+
+struct bilby_pool {
+	/* Head of the free list. Each free object stores the address of the next one. Read and written by inlined
+	   allocations and frees. */
+	void *free;
+	/* Runtime-only fields. */
+	size_t object_size;
+	size_t alignment;
+	size_t block_count;
+	struct bilby_pool_block *blocks;
+};
+
+struct bilby_arena *bilby_arena_create(size_t block_size);
+void *bilby_arena_grow(struct bilby_arena *arena, size_t size, size_t alignment);
+void bilby_arena_reset(struct bilby_arena *arena);
+void bilby_arena_destroy(struct bilby_arena *arena);
+
+struct bilby_pool *bilby_pool_create(size_t object_size, size_t alignment, size_t block_count);
+void *bilby_pool_grow(struct bilby_pool *pool);
+void bilby_pool_destroy(struct bilby_pool *pool);
+
+/* Runs `entry(argument)` on a new thread. Joining returns the value `entry` returned, and frees the thread. */
+struct bilby_thread;
+struct bilby_thread *bilby_thread_spawn(void *(*entry)(void *), void *argument);
+uint64_t bilby_thread_join(struct bilby_thread *thread);
@@ -0,0 +1,87 @@
+/* Minimal writer for LLVM's raw instrumentation profile (version 8), used by programs compiled with
+   `--profile-generate`. The format is that of compiler-rt's profile runtime, so `llvm-profdata merge` reads the
+   output. Value profiling and binary IDs are not supported. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PROFILE_RAW_MAGIC_64 ((uint64_t)255 << 56 | (uint64_t)'l' << 48 | (uint64_t)'p' << 40 | (uint64_t)'r' << 32 \
+                              | (uint64_t)'o' << 24 | (uint64_t)'f' << 16 | (uint64_t)'r' << 8 | (uint64_t)129)
+/* IPVK_Last in LLVM 14. */
+#define PROFILE_VALUE_KIND_LAST 1
+
+/* Section bounds are provided by the linker. They are weak so that an uninstrumented program still links. */
+extern char __start___llvm_prf_data[] __attribute__((weak));
+extern char __stop___llvm_prf_data[] __attribute__((weak));
+extern char __start___llvm_prf_cnts[] __attribute__((weak));
+extern char __stop___llvm_prf_cnts[] __attribute__((weak));
+extern char __start___llvm_prf_names[] __attribute__((weak));
+extern char __stop___llvm_prf_names[] __attribute__((weak));
+
+/* Emitted by the compiler in every instrumented module. */
+extern const uint64_t __llvm_profile_raw_version __attribute__((weak));
+extern const char __llvm_profile_filename[] __attribute__((weak));
+
+/* Referenced by instrumented modules so that this object is pulled out of the archive. */
+int __llvm_profile_runtime;
+
+/* Size of one `__llvm_prf_data` record: NameRef, FuncHash, CounterPtr, FunctionPointer, Values, NumCounters,
+   NumValueSites[2]. */
+#define PROFILE_DATA_SIZE 48
+
+static uint64_t padding(uint64_t size) {
+	return (8 - (size % 8)) % 8;
+}
+
+static void writeProfile(void) {
+	if (__start___llvm_prf_data == NULL) {
+		return;
+	}
+	const char *pattern = ((&__llvm_profile_filename != NULL) && (__llvm_profile_filename[0] != '\0')
+	                       ? __llvm_profile_filename
+	                       : "default.profraw");
+	char filename[4096] = "";
+	const char *pid = strstr(pattern, "%p");
+	if (pid != NULL) {
+		snprintf(filename, sizeof(filename), "%.*s%ld%s", (int) (pid - pattern), pattern, (long) getpid(), pid + 2);
+	}
+	else {
+		snprintf(filename, sizeof(filename), "%s", pattern);
+	}
+	FILE *file = fopen(filename, "wb");
+	if (file == NULL) {
+		fprintf(stderr, "bilby-runtime: Could not open profile %s\n", filename);
+		return;
+	}
+
+	uint64_t dataSize = __stop___llvm_prf_data - __start___llvm_prf_data;
+	uint64_t countersSize = __stop___llvm_prf_cnts - __start___llvm_prf_cnts;
+	uint64_t namesSize = __stop___llvm_prf_names - __start___llvm_prf_names;
+	uint64_t header[] = {
+		PROFILE_RAW_MAGIC_64,
+		__llvm_profile_raw_version,
+		0,                                /* BinaryIdsSize */
+		dataSize / PROFILE_DATA_SIZE,
+		0,                                /* PaddingBytesBeforeCounters */
+		countersSize / sizeof(uint64_t),
+		0,                                /* PaddingBytesAfterCounters */
+		namesSize,
+		(uintptr_t) __start___llvm_prf_cnts - (uintptr_t) __start___llvm_prf_data,
+		(uintptr_t) __start___llvm_prf_names,
+		PROFILE_VALUE_KIND_LAST
+	};
+	static const char zeros[8] = {0};
+	fwrite(header, sizeof(header), 1, file);
+	fwrite(__start___llvm_prf_data, 1, dataSize, file);
+	fwrite(__start___llvm_prf_cnts, 1, countersSize, file);
+	fwrite(__start___llvm_prf_names, 1, namesSize, file);
+	fwrite(zeros, 1, padding(namesSize), file);
+	fclose(file);
+}
+
+__attribute__((constructor)) static void registerProfileWriter(void) {
+	atexit(writeProfile);
+}
@@ -0,0 +1,31 @@
+/* Threads for compiled code. The compiler wraps the thread's function in an entry point with the C signature that
+   pthreads expects. */
+
+#include "bilby-runtime.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct bilby_thread {
+	pthread_t thread;
+};
+
+struct bilby_thread *bilby_thread_spawn(void *(*entry)(void *), void *argument) {
+	struct bilby_thread *thread = malloc(sizeof(struct bilby_thread));
+	if ((thread == NULL) || (pthread_create(&thread->thread, NULL, entry, argument) != 0)) {
+		fprintf(stderr, "bilby-runtime: Could not create thread.\n");
+		abort();
+	}
+	return thread;
+}
+
+uint64_t bilby_thread_join(struct bilby_thread *thread) {
+	void *result = NULL;
+	if (pthread_join(thread->thread, &result) != 0) {
+		fprintf(stderr, "bilby-runtime: Could not join thread.\n");
+		abort();
+	}
+	free(thread);
+	return (uintptr_t) result;
+}
@@ -1,34 +1,57 @@
 #include "backend.hpp"
+#include <chrono>
 #include <cstddef>
+#include <limits>
 #include <llvm/Support/CodeGen.h>
 #include <llvm/Support/raw_ostream.h>
 #include <memory>
+#include <set>
 #include <system_error>
+#include <unordered_map>
 #include <vector>
 #include <iostream>
 #include <llvm/ADT/APInt.h>
 #include <llvm/ADT/Optional.h>
 #include <llvm/ADT/STLExtras.h>
+#include <llvm/Analysis/ModuleSummaryAnalysis.h>
+#include <llvm/Analysis/ProfileSummaryInfo.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Constants.h>
+#include <llvm/IR/DIBuilder.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Mangler.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Verifier.h>
+#include <llvm/MC/SubtargetFeature.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Object/SymbolSize.h>
 #include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/ARMTargetParser.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/Host.h>
+#include <llvm/Support/Path.h>
 #include <llvm/Support/TargetSelect.h>
 #include <llvm/Support/raw_os_ostream.h>
 #include <llvm/Target/TargetMachine.h>
 #include <llvm/Target/TargetOptions.h>
 #include <llvm/Transforms/InstCombine/InstCombine.h>
+#include <llvm/Transforms/Instrumentation.h>
 #include <llvm/Transforms/Scalar.h>
 #include <llvm/Transforms/Scalar/GVN.h>
+#include <llvm/Transforms/Utils.h>
+#include <llvm/Transforms/Utils/ModuleUtils.h>
+#include <llvm/Transforms/Vectorize.h>
+#include <map>
 #include "parser.hpp"
 
 namespace Backend {
@@ -37,100 +60,1725 @@ namespace Backend {
 	static std::unique_ptr<Module> llvmModule;
 	static std::unique_ptr<IRBuilder<>> irBuilder;
 	static std::unique_ptr<legacy::FunctionPassManager> llvmFpm;
+	static bool quiet = false;
+	static OptimizationGoal optimizationGoal = SPEED;
+	static bool freestanding = false;
+	static std::string textSection = "";
+	// Thumb code cannot always be tail called, so the backend would reject `musttail`.
+	static bool guaranteedTailCalls = true;
+	// AST nodes of each function's definition, counted for `--cost-report`.
+	static bool costReport = false;
+	static std::unordered_map<Function *, uint64_t> astNodeCounts;
+	static std::map<std::string, AllocaInst *> namedValues;
+	// Set once `ref` takes the address of a local in the current function. Its tail calls are then left unmarked,
+	// since the callee may read the caller's frame.
+	static bool frameAddressTaken = false;
+	// Parameter slots and loop header of the function being generated. Self tail calls store into the slots and
+	// branch back to the header, so self-recursion runs in constant stack space regardless of optimization level.
+	static std::vector<AllocaInst *> parameterAllocas;
+	static BasicBlock *recurBlock = nullptr;
+	// Exit blocks of the loops enclosing the current form, innermost last.
+	static std::vector<BasicBlock *> loopExits;
+	// Only set when generating debug info. Forms inside a function are given locations in `debugScope`.
+	static std::unique_ptr<DIBuilder> diBuilder;
+	static DIFile *debugFile = nullptr;
+	static DISubprogram *debugScope = nullptr;
+
+	struct StructDefinition {
+		StructType *type = nullptr;
+		// Arrays of a struct-of-arrays record are stored as one array per field.
+		bool soa = false;
+		uint64_t alignment = 0;
+		// Fields in layout order.
+		std::vector<std::pair<std::string, Type *>> fields;
+	};
+	static std::map<std::string, StructDefinition> structDefinitions;
+	// Records named by the declaration pass whose bodies have not been defined yet.
+	static std::map<std::string, Parser::Forms> pendingStructs;
+	// Field name to element index for every record type and every struct-of-arrays type. Padding has no name.
+	static std::map<Type *, std::map<std::string, unsigned int>> fieldIndices;
+	// Struct-of-arrays types, keyed by record name and length.
+	static std::map<std::pair<std::string, uint64_t>, StructType *> soaArrayTypes;
+	static std::set<Type *> soaArrays;
+	// Alignment requested with `:align`, for types that have one.
+	static std::map<Type *, uint64_t> typeAlignments;
+
+	struct Declaration {
+		Function *function = nullptr;
+		// Declared with `extern`, so the function keeps external linkage and the C calling convention.
+		bool external = false;
+		// Has a `defun` with a body in this module.
+		bool defined = false;
+	};
+	// Every function known to the module. Filled in before any body is lowered so that calls may refer forward.
+	static std::unordered_map<std::string, Declaration> declarations;
+	// Set when a declaration or a top-level form fails to lower. The program is then rejected and no output is written.
+	static bool programRejected = false;
+
+	// The target's `size_t`.
+	IntegerType *sizeType() {
+		return llvmModule->getDataLayout().getIntPtrType(*llvmContext);
+	}
+
+	// Must match `struct bilby_arena` in runtime/bilby-runtime.h.
+	StructType *arenaType() {
+		StructType *type = StructType::getTypeByName(*llvmContext, "bilby.arena");
+		if (type == nullptr) {
+			Type *bytePointer = Type::getInt8PtrTy(*llvmContext);
+			type = StructType::create(*llvmContext, {bytePointer, bytePointer, bytePointer, sizeType()}, "bilby.arena");
+		}
+		return type;
+	}
+
+	// Must match `struct bilby_pool` in runtime/bilby-runtime.h.
+	StructType *poolType() {
+		StructType *type = StructType::getTypeByName(*llvmContext, "bilby.pool");
+		if (type == nullptr) {
+			Type *bytePointer = Type::getInt8PtrTy(*llvmContext);
+			Type *size = sizeType();
+			type = StructType::create(*llvmContext, {bytePointer, size, size, size, bytePointer}, "bilby.pool");
+		}
+		return type;
+	}
+
+	// Opaque. Only the runtime knows its layout.
+	StructType *threadType() {
+		StructType *type = StructType::getTypeByName(*llvmContext, "bilby.thread");
+		if (type == nullptr) {
+			type = StructType::create(*llvmContext, "bilby.thread");
+		}
+		return type;
+	}
 
 	Type *toType(std::string typeName) {
 		if (typeName == "ui64") {
 			return Type::getInt64Ty(*llvmContext);
 		}
-		else if (typeName == "ui32") {
-			return Type::getInt32Ty(*llvmContext);
+		else if (typeName == "ui32") {
+			return Type::getInt32Ty(*llvmContext);
+		}
+		else if (typeName == "ui16") {
+			return Type::getInt16Ty(*llvmContext);
+		}
+		else if (typeName == "ui8") {
+			return Type::getInt8Ty(*llvmContext);
+		}
+		else if (structDefinitions.count(typeName) != 0) {
+			return structDefinitions[typeName].type;
+		}
+		else if (typeName == "arena") {
+			return arenaType();
+		}
+		else if (typeName == "pool") {
+			return poolType();
+		}
+		else if (typeName == "thread") {
+			return threadType();
+		}
+		else {
+			return nullptr;
+		}
+	}
+
+	// Appends `[n x i8]` so that the next element starts at a multiple of `alignment`.
+	void appendPadding(std::vector<Type *> &elements, uint64_t &offset, uint64_t alignment) {
+		uint64_t padding = alignTo(offset, alignment) - offset;
+		if (padding != 0) {
+			elements.push_back(ArrayType::get(Type::getInt8Ty(*llvmContext), padding));
+			offset += padding;
+		}
+	}
+
+	// An array of a `:soa` record becomes a struct with one array per field. Each array starts on the record's
+	// alignment so that every field can be loaded with aligned vector instructions.
+	StructType *toSoaArrayType(std::string name, uint64_t length) {
+		auto key = std::make_pair(name, length);
+		if (soaArrayTypes.count(key) != 0) {
+			return soaArrayTypes[key];
+		}
+		auto &definition = structDefinitions[name];
+		auto &dataLayout = llvmModule->getDataLayout();
+		std::vector<Type *> elements;
+		std::map<std::string, unsigned int> indices;
+		uint64_t offset = 0;
+		for (auto &field: definition.fields) {
+			Type *array = ArrayType::get(field.second, length);
+			offset = alignTo(offset, dataLayout.getABITypeAlign(array));
+			indices[field.first] = elements.size();
+			elements.push_back(array);
+			offset += dataLayout.getTypeAllocSize(array);
+			if (definition.alignment != 0) {
+				appendPadding(elements, offset, definition.alignment);
+			}
+		}
+		StructType *type = StructType::create(*llvmContext, elements, name + ".soa");
+		soaArrayTypes[key] = type;
+		soaArrays.insert(type);
+		fieldIndices[type] = indices;
+		if (definition.alignment != 0) {
+			typeAlignments[type] = definition.alignment;
+		}
+		return type;
+	}
+
+	/* `(ptr type :unaligned)` points to a `type` that may start at any byte, such as a field of a `:packed` record. The
+	   pointee is a one-element packed structure, whose alignment is 1, so the alignment is part of the pointer's type
+	   and survives variables, parameters and stores. */
+	Type *unalignedType(Type *type) {
+		return StructType::get(*llvmContext, {type}, true);
+	}
+
+	bool isUnalignedType(Type *type) {
+		auto structType = dyn_cast<StructType>(type);
+		return (structType != nullptr) && structType->isLiteral() && structType->isPacked()
+		       && (structType->getNumElements() == 1);
+	}
+
+	// A type is either a name or a form such as `(vec ui32 8)`.
+	Type *toType(Parser::Form typeForm) {
+		if (typeForm.type == Parser::IDENTIFIER) {
+			return toType(*typeForm.identifier);
+		}
+		if ((typeForm.type != Parser::FORM) || (typeForm.forms->size() == 0)) {
+			// Error.
+			return nullptr;
+		}
+		auto forms = *typeForm.forms;
+		if ((forms[0].type == Parser::IDENTIFIER) && (*forms[0].identifier == "ptr")
+		    && ((forms.size() == 2)
+		        || ((forms.size() == 3) && (forms[2].type == Parser::IDENTIFIER) && (*forms[2].identifier == ":unaligned")))) {
+			// (ptr type [:unaligned])
+			Type *pointeeType = toType(forms[1]);
+			if (pointeeType == nullptr) {
+				// Error.
+				return nullptr;
+			}
+			return PointerType::getUnqual((forms.size() == 3) ? unalignedType(pointeeType) : pointeeType);
+		}
+		if ((forms[0].type != Parser::IDENTIFIER)
+		    || ((*forms[0].identifier != "vec") && (*forms[0].identifier != "array"))) {
+			// Error.
+			return nullptr;
+		}
+		if ((forms.size() != 3) || (forms[2].type != Parser::INTEGER) || (forms[2].integer == 0)) {
+			// Error.
+			return nullptr;
+		}
+		if (*forms[0].identifier == "array") {
+			// (array type length)
+			if ((forms[1].type == Parser::IDENTIFIER) && (structDefinitions.count(*forms[1].identifier) != 0)
+			    && structDefinitions[*forms[1].identifier].soa) {
+				return toSoaArrayType(*forms[1].identifier, forms[2].integer);
+			}
+			Type *elementType = toType(forms[1]);
+			if (elementType == nullptr) {
+				// Error.
+				return nullptr;
+			}
+			return ArrayType::get(elementType, forms[2].integer);
+		}
+		Type *elementType = toType(forms[1]);
+		if ((elementType == nullptr) || !elementType->isIntegerTy()) {
+			// Error.
+			return nullptr;
+		}
+		return FixedVectorType::get(elementType, forms[2].integer);
+	}
+
+	// `tail` is true when the value of the form is the return value of the enclosing function. Forms in tail position
+	// emit their own `ret` (or branch), so the caller must check whether the insert block has been terminated.
+	Value *generateForm(Parser::Form form, bool tail = false);
+
+	bool isTerminated() {
+		return irBuilder->GetInsertBlock()->getTerminator() != nullptr;
+	}
+
+	// All integers are unsigned, so widening is always a zero extension. Scalars are splatted into vectors.
+	Value *coerce(Value *value, Type *type) {
+		if ((value == nullptr) || (type == nullptr) || (value->getType() == type)) {
+			return value;
+		}
+		if (value->getType()->isIntegerTy() && type->isIntegerTy()) {
+			return irBuilder->CreateZExtOrTrunc(value, type);
+		}
+		if (value->getType()->isIntegerTy() && type->isVectorTy()) {
+			auto vectorType = cast<FixedVectorType>(type);
+			value = coerce(value, vectorType->getElementType());
+			return irBuilder->CreateVectorSplat(vectorType->getNumElements(), value, "splattmp");
+		}
+		if (value->getType()->isPointerTy() && type->isPointerTy()) {
+			if (isUnalignedType(value->getType()->getPointerElementType())
+			    && (llvmModule->getDataLayout().getABITypeAlign(type->getPointerElementType()) > 1)) {
+				std::cout << "An :unaligned pointer cannot become an aligned one" << std::endl;
+				return nullptr;
+			}
+			return irBuilder->CreatePointerCast(value, type);
+		}
+		if (value->getType()->isIntegerTy() && type->isPointerTy()) {
+			return irBuilder->CreateIntToPtr(value, type);
+		}
+		if (value->getType()->isVectorTy() && type->isVectorTy()) {
+			auto from = cast<FixedVectorType>(value->getType());
+			auto to = cast<FixedVectorType>(type);
+			if (from->getNumElements() == to->getNumElements()) {
+				return irBuilder->CreateZExtOrTrunc(value, type);
+			}
+		}
+		// Error.
+		return value;
+	}
+
+	Value *generateReturn(Value *value) {
+		Function *function = irBuilder->GetInsertBlock()->getParent();
+		value = coerce(value, function->getReturnType());
+		if (value == nullptr) {
+			// Error.
+			return nullptr;
+		}
+		return irBuilder->CreateRet(value);
+	}
+
+	Value *generateInteger(Parser::Form form) {
+		unsigned int width = (form.integer > UINT32_MAX) ? 64 : 32;
+		return ConstantInt::get(*llvmContext, APInt(width, form.integer));
+	}
+
+	Value *generateVariable(Parser::Form form) {
+		auto name = *form.identifier;
+		auto variable = namedValues.find(name);
+		if (variable == namedValues.end()) {
+			std::cout << "Unknown variable " << name << std::endl;
+			// Error.
+			return nullptr;
+		}
+		AllocaInst *alloca = variable->second;
+		return irBuilder->CreateLoad(alloca->getAllocatedType(), alloca, name);
+	}
+
+	// Allocas go in the entry block so that mem2reg can promote them.
+	AllocaInst *createEntryAlloca(Type *type, std::string name) {
+		Function *function = irBuilder->GetInsertBlock()->getParent();
+		IRBuilder<> entryBuilder(&function->getEntryBlock(), function->getEntryBlock().begin());
+		return entryBuilder.CreateAlloca(type, nullptr, name);
+	}
+
+	// The alignment requested with `:align`, looking through arrays.
+	uint64_t alignmentOf(Type *type) {
+		while (type->isArrayTy()) {
+			type = type->getArrayElementType();
+		}
+		return (typeAlignments.count(type) != 0) ? typeAlignments[type] : 0;
+	}
+
+	/* (defstruct name [:packed] [:reorder] [:align n] [:soa] (field::type ...))
+	   `:packed` removes padding between fields. `:reorder` sorts fields by decreasing alignment so that padding is
+	   minimal. `:align` rounds the record size up to a multiple of `n` and aligns variables to `n`. `:soa` stores
+	   arrays of the record as one array per field. */
+	Value *generateStruct(Parser::Forms forms);
+
+	// Defines the records that a field type contains by value, if they are declared but not defined yet. Records
+	// behind a pointer may stay opaque.
+	void defineContainedStructs(Parser::Form &typeForm) {
+		if (typeForm.type == Parser::IDENTIFIER) {
+			auto pending = pendingStructs.find(*typeForm.identifier);
+			if (pending != pendingStructs.end()) {
+				generateStruct(pending->second);
+			}
+		}
+		else if ((typeForm.type == Parser::FORM) && (typeForm.forms->size() > 0)
+		         && !(((*typeForm.forms)[0].type == Parser::IDENTIFIER) && (*(*typeForm.forms)[0].identifier == "ptr"))) {
+			for (auto &form: *typeForm.forms) {
+				defineContainedStructs(form);
+			}
+		}
+	}
+
+	Value *generateStruct(Parser::Forms forms) {
+		if ((forms.size() < 3) || (forms[1].type != Parser::IDENTIFIER) || (forms.back().type != Parser::FORM)) {
+			// Error.
+			return nullptr;
+		}
+		auto name = *forms[1].identifier;
+		// A record declared by the declaration pass already has its type, but no body yet.
+		StructType *declaredType = nullptr;
+		if (pendingStructs.count(name) != 0) {
+			pendingStructs.erase(name);
+			declaredType = structDefinitions[name].type;
+		}
+		else if (structDefinitions.count(name) != 0) {
+			// Error.
+			return nullptr;
+		}
+		StructDefinition definition;
+		bool packed = false;
+		bool reorder = false;
+		for (std::ptrdiff_t i = 2; i < forms.size() - 1; i++) {
+			if (forms[i].type != Parser::IDENTIFIER) {
+				// Error.
+				return nullptr;
+			}
+			auto option = *forms[i].identifier;
+			if (option == ":packed") {
+				packed = true;
+			}
+			else if (option == ":reorder") {
+				reorder = true;
+			}
+			else if (option == ":soa") {
+				definition.soa = true;
+			}
+			else if ((option == ":align") && (i + 1 < forms.size() - 1) && (forms[i + 1].type == Parser::INTEGER)
+			         && isPowerOf2_64(forms[i + 1].integer)) {
+				definition.alignment = forms[++i].integer;
+			}
+			else {
+				// Error.
+				return nullptr;
+			}
+		}
+		// The type exists before its fields are resolved so that fields may point to the record itself.
+		definition.type = (declaredType != nullptr) ? declaredType : StructType::create(*llvmContext, name);
+		structDefinitions[name] = definition;
+		for (auto &field: *forms.back().forms) {
+			if ((field.type != Parser::IDENTIFIER) || (field.typeAnnotation == nullptr)) {
+				// Error.
+				structDefinitions.erase(name);
+				return nullptr;
+			}
+			defineContainedStructs(*field.typeAnnotation);
+			Type *type = toType(*field.typeAnnotation);
+			if ((type == nullptr) || !type->isSized()) {
+				// Error.
+				structDefinitions.erase(name);
+				return nullptr;
+			}
+			definition.fields.push_back({*field.identifier, type});
+		}
+		auto &dataLayout = llvmModule->getDataLayout();
+		if (reorder) {
+			std::stable_sort(definition.fields.begin(), definition.fields.end(), [&](auto &a, auto &b) {
+				return dataLayout.getABITypeAlign(a.second) > dataLayout.getABITypeAlign(b.second);
+			});
+		}
+		std::vector<Type *> elements;
+		std::map<std::string, unsigned int> indices;
+		for (auto &field: definition.fields) {
+			indices[field.first] = elements.size();
+			elements.push_back(field.second);
+		}
+		definition.type->setBody(elements, packed);
+		if (definition.alignment != 0) {
+			uint64_t size = dataLayout.getTypeAllocSize(definition.type);
+			appendPadding(elements, size, definition.alignment);
+			definition.type->setBody(elements, packed);
+			typeAlignments[definition.type] = definition.alignment;
+		}
+		fieldIndices[definition.type] = indices;
+		structDefinitions[name] = definition;
+		return UndefValue::get(definition.type);
+	}
+
+	// Returns the address of the value that `pointer` points to, and the alignment that accesses to it may assume.
+	Value *accessAddress(Value *pointer, Align &alignment) {
+		Type *pointeeType = pointer->getType()->getPointerElementType();
+		alignment = llvmModule->getDataLayout().getABITypeAlign(pointeeType);
+		if (isUnalignedType(pointeeType)) {
+			return irBuilder->CreateStructGEP(pointeeType, pointer, 0, "unalignedptr");
+		}
+		return pointer;
+	}
+
+	/* Computes the address named by `(get base path...)` or `(put base path... value)`. Each element of the path
+	   selects into the type reached so far: arrays take an index expression, records take a field name, and
+	   struct-of-arrays take an index followed by a field name. `alignment` is the alignment of the element, which
+	   is less than the type's own in a `:packed` record. */
+	Value *generateElementAddress(Parser::Form base, Parser::Forms path, Type *&type, Align &alignment) {
+		auto &dataLayout = llvmModule->getDataLayout();
+		// A variable is accessed in place. Any other base must be a pointer, which is accessed through.
+		Value *baseAddress = nullptr;
+		if ((base.type == Parser::IDENTIFIER) && (namedValues.count(*base.identifier) != 0)
+		    && !namedValues[*base.identifier]->getAllocatedType()->isPointerTy()) {
+			baseAddress = namedValues[*base.identifier];
+			type = namedValues[*base.identifier]->getAllocatedType();
+			alignment = namedValues[*base.identifier]->getAlign();
+		}
+		else {
+			baseAddress = generateForm(base);
+			if ((baseAddress == nullptr) || !baseAddress->getType()->isPointerTy()) {
+				// Error.
+				return nullptr;
+			}
+			baseAddress = accessAddress(baseAddress, alignment);
+			type = baseAddress->getType()->getPointerElementType();
+		}
+		Type *baseType = type;
+		std::vector<Value *> indices = {irBuilder->getInt32(0)};
+		auto fieldIndex = [&](Type *recordType, Parser::Form form) -> Value * {
+			if ((form.type != Parser::IDENTIFIER) || (fieldIndices[recordType].count(*form.identifier) == 0)) {
+				return nullptr;
+			}
+			return irBuilder->getInt32(fieldIndices[recordType][*form.identifier]);
+		};
+		for (std::ptrdiff_t i = 0; i < path.size(); i++) {
+			if (type->isArrayTy()) {
+				Value *index = generateForm(path[i]);
+				if ((index == nullptr) || !index->getType()->isIntegerTy()) {
+					// Error.
+					return nullptr;
+				}
+				indices.push_back(coerce(index, Type::getInt64Ty(*llvmContext)));
+				type = type->getArrayElementType();
+				alignment = commonAlignment(alignment, dataLayout.getTypeAllocSize(type));
+			}
+			else if (soaArrays.count(type) != 0) {
+				if (i + 1 >= path.size()) {
+					// Error.
+					return nullptr;
+				}
+				Value *index = generateForm(path[i]);
+				Value *field = fieldIndex(type, path[i + 1]);
+				if ((index == nullptr) || !index->getType()->isIntegerTy() || (field == nullptr)) {
+					// Error.
+					return nullptr;
+				}
+				auto fieldNumber = cast<ConstantInt>(field)->getZExtValue();
+				alignment = commonAlignment(alignment,
+				                            dataLayout.getStructLayout(cast<StructType>(type))->getElementOffset(fieldNumber));
+				type = type->getStructElementType(fieldNumber);
+				indices.push_back(field);
+				indices.push_back(coerce(index, Type::getInt64Ty(*llvmContext)));
+				type = type->getArrayElementType();
+				alignment = commonAlignment(alignment, dataLayout.getTypeAllocSize(type));
+				i++;
+			}
+			else if (type->isStructTy()) {
+				Value *field = fieldIndex(type, path[i]);
+				if (field == nullptr) {
+					// Error.
+					return nullptr;
+				}
+				auto fieldNumber = cast<ConstantInt>(field)->getZExtValue();
+				// Fields of a packed record start at any byte, so the offset decides what remains of the alignment.
+				alignment = commonAlignment(alignment,
+				                            dataLayout.getStructLayout(cast<StructType>(type))->getElementOffset(fieldNumber));
+				indices.push_back(field);
+				type = type->getStructElementType(fieldNumber);
+			}
+			else {
+				// Error.
+				return nullptr;
+			}
+		}
+		if (indices.size() == 1) {
+			return baseAddress;
+		}
+		return irBuilder->CreateInBoundsGEP(baseType, baseAddress, indices, "elementptr");
+	}
+
+	// (get base path...)
+	Value *generateGet(Parser::Forms forms) {
+		if (forms.size() < 3) {
+			// Error.
+			return nullptr;
+		}
+		Type *type = nullptr;
+		Align alignment;
+		Value *address = generateElementAddress(forms[1], Parser::Forms(forms.begin() + 2, forms.end()), type, alignment);
+		if (address == nullptr) {
+			// Error.
+			return nullptr;
+		}
+		return irBuilder->CreateAlignedLoad(type, address, alignment, "gettmp");
+	}
+
+	// (put base path... value)
+	Value *generatePut(Parser::Forms forms) {
+		if (forms.size() < 4) {
+			// Error.
+			return nullptr;
+		}
+		Type *type = nullptr;
+		Align alignment;
+		Value *address = generateElementAddress(forms[1],
+		                                        Parser::Forms(forms.begin() + 2, forms.end() - 1),
+		                                        type,
+		                                        alignment);
+		Value *value = (address != nullptr) ? generateForm(forms.back()) : nullptr;
+		if (value == nullptr) {
+			// Error.
+			return nullptr;
+		}
+		value = coerce(value, type);
+		if (value == nullptr) {
+			// Error.
+			return nullptr;
+		}
+		irBuilder->CreateAlignedStore(value, address, alignment);
+		return value;
+	}
+
+	/* (ref base path...) is the address that `get` would read, e.g. for atomic operations on a field. The address of
+	   a misaligned field in a `:packed` record is a `(ptr type :unaligned)`. */
+	Value *generateRef(Parser::Forms forms) {
+		if (forms.size() < 2) {
+			// Error.
+			return nullptr;
+		}
+		Type *type = nullptr;
+		Align alignment;
+		Value *address = generateElementAddress(forms[1], Parser::Forms(forms.begin() + 2, forms.end()), type, alignment);
+		if (address == nullptr) {
+			// Error.
+			return nullptr;
+		}
+		frameAddressTaken |= isa<AllocaInst>(getUnderlyingObject(address));
+		if (alignment < llvmModule->getDataLayout().getABITypeAlign(type)) {
+			return irBuilder->CreateBitCast(address, PointerType::getUnqual(unalignedType(type)), "unaligned");
+		}
+		return address;
+	}
+
+	// (load pointer)
+	Value *generateLoad(Parser::Forms forms) {
+		Value *pointer = (forms.size() == 2) ? generateForm(forms[1]) : nullptr;
+		if ((pointer == nullptr) || !pointer->getType()->isPointerTy()) {
+			// Error.
+			return nullptr;
+		}
+		Align alignment;
+		pointer = accessAddress(pointer, alignment);
+		return irBuilder->CreateAlignedLoad(pointer->getType()->getPointerElementType(), pointer, alignment, "loadtmp");
+	}
+
+	// (store pointer value)
+	Value *generateStore(Parser::Forms forms) {
+		Value *pointer = (forms.size() == 3) ? generateForm(forms[1]) : nullptr;
+		Value *value = (pointer != nullptr) ? generateForm(forms[2]) : nullptr;
+		if ((value == nullptr) || !pointer->getType()->isPointerTy()) {
+			// Error.
+			return nullptr;
+		}
+		Align alignment;
+		pointer = accessAddress(pointer, alignment);
+		value = coerce(value, pointer->getType()->getPointerElementType());
+		if (value == nullptr) {
+			// Error.
+			return nullptr;
+		}
+		irBuilder->CreateAlignedStore(value, pointer, alignment);
+		return value;
+	}
+
+	// The weights `__builtin_expect` uses for a likely branch.
+	MDNode *likelyBranchWeights() {
+		return MDBuilder(*llvmContext).createBranchWeights(2000, 1);
+	}
+
+	bool isAllocatorBuiltin(std::string keyword) {
+		static const std::set<std::string> builtins = {"arena-create", "arena-new", "arena-reset", "arena-destroy",
+		                                               "pool-create", "pool-new", "pool-delete", "pool-destroy"};
+		return builtins.count(keyword) != 0;
+	}
+
+	FunctionCallee runtimeFunction(std::string name, Type *returnType, std::vector<Type *> parameterTypes) {
+		return llvmModule->getOrInsertFunction(name, FunctionType::get(returnType, parameterTypes, false));
+	}
+
+	/* Allocation fast paths are inlined. The runtime is only called to create and destroy allocators and when the
+	   current arena block or the pool's free list is exhausted. */
+	Value *generateAllocatorBuiltin(std::string keyword, Parser::Forms forms) {
+		auto &dataLayout = llvmModule->getDataLayout();
+		Type *bytePointer = Type::getInt8PtrTy(*llvmContext);
+		Type *size = sizeType();
+		Type *arenaPointer = PointerType::getUnqual(arenaType());
+		Type *poolPointer = PointerType::getUnqual(poolType());
+		Value *zero = Constant::getNullValue(Type::getInt32Ty(*llvmContext));
+
+		if (keyword == "arena-create") {
+			// (arena-create block-size)
+			Value *blockSize = (forms.size() == 2) ? generateForm(forms[1]) : nullptr;
+			if (blockSize == nullptr) {
+				// Error.
+				return nullptr;
+			}
+			auto create = runtimeFunction("bilby_arena_create", arenaPointer, {size});
+			return irBuilder->CreateCall(create, {coerce(blockSize, size)}, "arena");
+		}
+		if (keyword == "pool-create") {
+			// (pool-create type block-count)
+			Type *objectType = (forms.size() == 3) ? toType(forms[1]) : nullptr;
+			Value *blockCount = (objectType != nullptr) ? generateForm(forms[2]) : nullptr;
+			if (blockCount == nullptr) {
+				// Error.
+				return nullptr;
+			}
+			uint64_t alignment = std::max<uint64_t>(dataLayout.getABITypeAlign(objectType).value(),
+			                                        alignmentOf(objectType));
+			auto create = runtimeFunction("bilby_pool_create", poolPointer, {size, size, size});
+			return irBuilder->CreateCall(create, {ConstantInt::get(size, dataLayout.getTypeAllocSize(objectType)),
+			                                      ConstantInt::get(size, alignment),
+			                                      coerce(blockCount, size)}, "pool");
+		}
+
+		Value *allocator = (forms.size() >= 2) ? generateForm(forms[1]) : nullptr;
+		bool isArena = keyword.rfind("arena-", 0) == 0;
+		if ((allocator == nullptr) || (allocator->getType() != (isArena ? arenaPointer : poolPointer))) {
+			// Error.
+			return nullptr;
+		}
+		if ((keyword == "arena-reset") || (keyword == "arena-destroy") || (keyword == "pool-destroy")) {
+			if (forms.size() != 2) {
+				// Error.
+				return nullptr;
+			}
+			std::string name = ((keyword == "arena-reset")
+			                    ? "bilby_arena_reset"
+			                    : (keyword == "arena-destroy")
+			                    ? "bilby_arena_destroy"
+			                    : "bilby_pool_destroy");
+			irBuilder->CreateCall(runtimeFunction(name, Type::getVoidTy(*llvmContext), {allocator->getType()}),
+			                      {allocator});
+			return zero;
+		}
+		if (keyword == "pool-delete") {
+			// (pool-delete pool pointer) pushes the object onto the free list.
+			Value *object = (forms.size() == 3) ? generateForm(forms[2]) : nullptr;
+			if ((object == nullptr) || !object->getType()->isPointerTy()) {
+				// Error.
+				return nullptr;
+			}
+			Value *freeAddress = irBuilder->CreateStructGEP(poolType(), allocator, 0, "freeptr");
+			Value *link = irBuilder->CreatePointerCast(object, PointerType::getUnqual(bytePointer));
+			irBuilder->CreateStore(irBuilder->CreateLoad(bytePointer, freeAddress, "free"), link);
+			irBuilder->CreateStore(irBuilder->CreatePointerCast(object, bytePointer), freeAddress);
+			return zero;
+		}
+
+		// (arena-new arena type) and (pool-new pool type)
+		Type *objectType = (forms.size() == 3) ? toType(forms[2]) : nullptr;
+		if (objectType == nullptr) {
+			// Error.
+			return nullptr;
+		}
+		Function *function = irBuilder->GetInsertBlock()->getParent();
+		BasicBlock *fastBlock = BasicBlock::Create(*llvmContext, "allocfast", function);
+		BasicBlock *slowBlock = BasicBlock::Create(*llvmContext, "allocslow", function);
+		BasicBlock *contBlock = BasicBlock::Create(*llvmContext, "alloccont", function);
+		Value *fastResult = nullptr;
+		Value *slowResult = nullptr;
+		if (isArena) {
+			uint64_t objectSize = dataLayout.getTypeAllocSize(objectType);
+			uint64_t alignment = std::max<uint64_t>(dataLayout.getABITypeAlign(objectType).value(),
+			                                        alignmentOf(objectType));
+			Value *cursorAddress = irBuilder->CreateStructGEP(arenaType(), allocator, 0, "cursorptr");
+			Value *endAddress = irBuilder->CreateStructGEP(arenaType(), allocator, 1, "endptr");
+			Value *cursor = irBuilder->CreateLoad(bytePointer, cursorAddress, "cursor");
+			Value *end = irBuilder->CreateLoad(bytePointer, endAddress, "end");
+			// The check is done on integers, since a pointer past the end of the block would be poison.
+			Value *cursorInteger = irBuilder->CreatePtrToInt(cursor, size);
+			Value *padding = irBuilder->CreateAnd(irBuilder->CreateNeg(cursorInteger), alignment - 1, "padding");
+			Value *room = irBuilder->CreateSub(irBuilder->CreatePtrToInt(end, size), cursorInteger, "room");
+			Value *needed = irBuilder->CreateAdd(padding, ConstantInt::get(size, objectSize), "needed");
+			Value *fits = irBuilder->CreateICmpULE(needed, room, "fits");
+			irBuilder->CreateCondBr(fits, fastBlock, slowBlock, likelyBranchWeights());
+			irBuilder->SetInsertPoint(fastBlock);
+			// Within the block, so bump with GEPs rather than integer arithmetic so alias analysis can follow the
+			// pointer.
+			Value *aligned = irBuilder->CreateInBoundsGEP(Type::getInt8Ty(*llvmContext), cursor, padding, "aligned");
+			Value *next = irBuilder->CreateInBoundsGEP(Type::getInt8Ty(*llvmContext), aligned,
+			                                           ConstantInt::get(size, objectSize), "next");
+			irBuilder->CreateStore(next, cursorAddress);
+			fastResult = aligned;
+			irBuilder->CreateBr(contBlock);
+			irBuilder->SetInsertPoint(slowBlock);
+			auto grow = runtimeFunction("bilby_arena_grow", bytePointer, {arenaPointer, size, size});
+			slowResult = irBuilder->CreateCall(grow, {allocator, ConstantInt::get(size, objectSize),
+			                                          ConstantInt::get(size, alignment)});
+		}
+		else {
+			Value *freeAddress = irBuilder->CreateStructGEP(poolType(), allocator, 0, "freeptr");
+			Value *head = irBuilder->CreateLoad(bytePointer, freeAddress, "head");
+			Value *available = irBuilder->CreateIsNotNull(head, "available");
+			irBuilder->CreateCondBr(available, fastBlock, slowBlock, likelyBranchWeights());
+			irBuilder->SetInsertPoint(fastBlock);
+			Value *link = irBuilder->CreatePointerCast(head, PointerType::getUnqual(bytePointer));
+			irBuilder->CreateStore(irBuilder->CreateLoad(bytePointer, link, "next"), freeAddress);
+			fastResult = head;
+			irBuilder->CreateBr(contBlock);
+			irBuilder->SetInsertPoint(slowBlock);
+			auto grow = runtimeFunction("bilby_pool_grow", bytePointer, {poolPointer});
+			slowResult = irBuilder->CreateCall(grow, {allocator});
+		}
+		cast<CallInst>(slowResult)->addFnAttr(Attribute::Cold);
+		irBuilder->CreateBr(contBlock);
+		irBuilder->SetInsertPoint(contBlock);
+		PHINode *phi = irBuilder->CreatePHI(bytePointer, 2, "object");
+		phi->addIncoming(fastResult, fastBlock);
+		phi->addIncoming(slowResult, slowBlock);
+		return irBuilder->CreatePointerCast(phi, PointerType::getUnqual(objectType));
+	}
+
+	bool isAtomicBuiltin(std::string keyword) {
+		static const std::set<std::string> builtins = {"atomic-load", "atomic-store", "atomic-add", "atomic-sub",
+		                                               "atomic-and", "atomic-or", "atomic-xor", "atomic-xchg",
+		                                               "atomic-min", "atomic-max", "atomic-cas", "fence",
+		                                               "thread-spawn", "thread-join"};
+		return builtins.count(keyword) != 0;
+	}
+
+	// Reads an ordering keyword such as `:acquire`.
+	bool toOrdering(Parser::Form form, AtomicOrdering &ordering) {
+		static const std::map<std::string, AtomicOrdering> orderings = {
+			{":relaxed", AtomicOrdering::Monotonic},
+			{":acquire", AtomicOrdering::Acquire},
+			{":release", AtomicOrdering::Release},
+			{":acq-rel", AtomicOrdering::AcquireRelease},
+			{":seq-cst", AtomicOrdering::SequentiallyConsistent}
+		};
+		if ((form.type != Parser::IDENTIFIER) || (orderings.count(*form.identifier) == 0)) {
+			return false;
+		}
+		ordering = orderings.at(*form.identifier);
+		return true;
+	}
+
+	// Whether a value of `type` survives a round trip through a pointer.
+	bool fitsInPointer(Type *type) {
+		return type->isPointerTy()
+		       || (type->isIntegerTy()
+		           && (type->getIntegerBitWidth() <= llvmModule->getDataLayout().getPointerSizeInBits()));
+	}
+
+	/* A C entry point for `(thread-spawn function [argument])`. Pthreads call it with the argument as a pointer, and it
+	   calls the function, which may use the fast calling convention, with the argument converted to the parameter's
+	   type. The result is returned as a pointer so that `thread-join` can read it. */
+	Function *threadEntry(Function *function) {
+		std::string name = "bilby.thread." + function->getName().str();
+		Function *entry = llvmModule->getFunction(name);
+		if (entry != nullptr) {
+			return entry;
+		}
+		Type *bytePointer = Type::getInt8PtrTy(*llvmContext);
+		entry = Function::Create(FunctionType::get(bytePointer, {bytePointer}, false),
+		                         Function::InternalLinkage,
+		                         name,
+		                         llvmModule.get());
+		entry->addFnAttr(Attribute::NoUnwind);
+		IRBuilder<> builder(BasicBlock::Create(*llvmContext, "entry", entry));
+		std::vector<Value *> args;
+		if (function->arg_size() == 1) {
+			Type *parameterType = function->getArg(0)->getType();
+			Value *argument = entry->getArg(0);
+			args.push_back(parameterType->isPointerTy()
+			               ? builder.CreateBitCast(argument, parameterType)
+			               : builder.CreatePtrToInt(argument, parameterType));
+		}
+		CallInst *call = builder.CreateCall(function, args);
+		call->setCallingConv(function->getCallingConv());
+		Type *returnType = function->getReturnType();
+		builder.CreateRet(returnType->isPointerTy()
+		                  ? builder.CreateBitCast(call, bytePointer)
+		                  : returnType->isIntegerTy()
+		                  ? builder.CreateIntToPtr(call, bytePointer)
+		                  : Constant::getNullValue(bytePointer));
+		return entry;
+	}
+
+	/* Atomic operations take a pointer to an integer, or for loads, stores and `atomic-cas` also to a pointer, and an
+	   optional ordering at the end, which defaults to `:seq-cst`. Read-modify-write operations and `atomic-cas` return
+	   the old value. */
+	Value *generateAtomicBuiltin(std::string keyword, Parser::Forms forms) {
+		AtomicOrdering ordering = AtomicOrdering::SequentiallyConsistent;
+		if (keyword == "fence") {
+			if ((forms.size() > 2) || ((forms.size() == 2) && !toOrdering(forms[1], ordering))
+			    || (ordering == AtomicOrdering::Monotonic)) {
+				// Error.
+				return nullptr;
+			}
+			irBuilder->CreateFence(ordering);
+			return Constant::getNullValue(Type::getInt32Ty(*llvmContext));
+		}
+		if (keyword == "thread-spawn") {
+			// (thread-spawn function [argument]) calls a function of at most one parameter on a new thread.
+			auto declaration = (((forms.size() == 2) || (forms.size() == 3)) && (forms[1].type == Parser::IDENTIFIER)
+			                    ? declarations.find(*forms[1].identifier)
+			                    : declarations.end());
+			if (declaration == declarations.end()) {
+				// Error.
+				return nullptr;
+			}
+			// The argument and the result travel through a `void *`.
+			Function *function = declaration->second.function;
+			Type *returnType = function->getReturnType();
+			if (function->arg_size() != forms.size() - 2) {
+				std::cout << "Wrong number of arguments to thread-spawn of " << function->getName().str() << std::endl;
+				return nullptr;
+			}
+			if (((function->arg_size() == 1) && !fitsInPointer(function->getArg(0)->getType()))
+			    || (returnType->isIntegerTy() && !fitsInPointer(returnType))) {
+				std::cout << "Function " << function->getName().str() << " cannot run on a thread" << std::endl;
+				return nullptr;
+			}
+			Type *bytePointer = Type::getInt8PtrTy(*llvmContext);
+			Value *argument = Constant::getNullValue(bytePointer);
+			if (forms.size() == 3) {
+				argument = coerce(generateForm(forms[2]), function->getArg(0)->getType());
+				if ((argument == nullptr) || (argument->getType() != function->getArg(0)->getType())) {
+					// Error.
+					return nullptr;
+				}
+			}
+			Function *entry = threadEntry(function);
+			auto spawn = runtimeFunction("bilby_thread_spawn",
+			                             PointerType::getUnqual(threadType()),
+			                             {entry->getType(), bytePointer});
+			return irBuilder->CreateCall(spawn, {entry, coerce(argument, bytePointer)}, "thread");
+		}
+		if (keyword == "thread-join") {
+			Value *thread = (forms.size() == 2) ? generateForm(forms[1]) : nullptr;
+			if ((thread == nullptr) || (thread->getType() != PointerType::getUnqual(threadType()))) {
+				// Error.
+				return nullptr;
+			}
+			auto join = runtimeFunction("bilby_thread_join", Type::getInt64Ty(*llvmContext), {thread->getType()});
+			return irBuilder->CreateCall(join, {thread}, "result");
+		}
+
+		std::size_t operandCount = ((keyword == "atomic-load")
+		                            ? 1
+		                            : (keyword == "atomic-cas")
+		                            ? 3
+		                            : 2);
+		if ((forms.size() != operandCount + 1) && (forms.size() != operandCount + 2)) {
+			// Error.
+			return nullptr;
+		}
+		if ((forms.size() == operandCount + 2) && !toOrdering(forms.back(), ordering)) {
+			// Error.
+			return nullptr;
+		}
+		Value *pointer = generateForm(forms[1]);
+		if ((pointer == nullptr) || !pointer->getType()->isPointerTy()) {
+			// Error.
+			return nullptr;
+		}
+		bool unaligned = isUnalignedType(pointer->getType()->getPointerElementType());
+		Align pointeeAlignment;
+		pointer = accessAddress(pointer, pointeeAlignment);
+		Type *type = pointer->getType()->getPointerElementType();
+		bool rmw = (keyword != "atomic-load") && (keyword != "atomic-store") && (keyword != "atomic-cas");
+		if (!(type->isIntegerTy() || (!rmw && type->isPointerTy()))) {
+			// Error.
+			return nullptr;
+		}
+		// Atomic accesses are naturally aligned, unless the pointer is `:unaligned`. Misaligned atomic accesses become
+		// calls into libatomic.
+		Align alignment = unaligned ? pointeeAlignment : Align(llvmModule->getDataLayout().getTypeStoreSize(type));
+		std::vector<Value *> operands;
+		for (std::size_t i = 2; i <= operandCount; i++) {
+			Value *operand = coerce(generateForm(forms[i]), type);
+			if (operand == nullptr) {
+				// Error.
+				return nullptr;
+			}
+			operands.push_back(operand);
+		}
+
+		if (keyword == "atomic-load") {
+			if ((ordering == AtomicOrdering::Release) || (ordering == AtomicOrdering::AcquireRelease)) {
+				// Error.
+				return nullptr;
+			}
+			LoadInst *load = irBuilder->CreateAlignedLoad(type, pointer, alignment, "atomictmp");
+			load->setAtomic(ordering);
+			return load;
+		}
+		if (keyword == "atomic-store") {
+			if ((ordering == AtomicOrdering::Acquire) || (ordering == AtomicOrdering::AcquireRelease)) {
+				// Error.
+				return nullptr;
+			}
+			StoreInst *store = irBuilder->CreateAlignedStore(operands[0], pointer, alignment);
+			store->setAtomic(ordering);
+			return operands[0];
+		}
+		if (keyword == "atomic-cas") {
+			// (atomic-cas pointer expected desired) stores `desired` only if the old value is `expected`.
+			auto cas = irBuilder->CreateAtomicCmpXchg(pointer,
+			                                          operands[0],
+			                                          operands[1],
+			                                          alignment,
+			                                          ordering,
+			                                          AtomicCmpXchgInst::getStrongestFailureOrdering(ordering));
+			return irBuilder->CreateExtractValue(cas, 0, "oldtmp");
+		}
+		static const std::map<std::string, AtomicRMWInst::BinOp> operations = {
+			{"atomic-add", AtomicRMWInst::Add},
+			{"atomic-sub", AtomicRMWInst::Sub},
+			{"atomic-and", AtomicRMWInst::And},
+			{"atomic-or", AtomicRMWInst::Or},
+			{"atomic-xor", AtomicRMWInst::Xor},
+			{"atomic-xchg", AtomicRMWInst::Xchg},
+			{"atomic-min", AtomicRMWInst::UMin},
+			{"atomic-max", AtomicRMWInst::UMax}
+		};
+		return irBuilder->CreateAtomicRMW(operations.at(keyword), pointer, operands[0], alignment, ordering);
+	}
+
+	// (let ((name[::type] [init]) ...) body...)
+	Value *generateLet(Parser::Forms forms, bool tail) {
+		if ((forms.size() < 3) || (forms[1].type != Parser::FORM)) {
+			// Error.
+			return nullptr;
+		}
+		std::vector<std::pair<std::string, AllocaInst *>> shadowed;
+		for (auto &binding: *forms[1].forms) {
+			if ((binding.type != Parser::FORM) || (binding.forms->size() < 1) || (binding.forms->size() > 2)
+			    || ((*binding.forms)[0].type != Parser::IDENTIFIER)) {
+				// Error.
+				return nullptr;
+			}
+			auto nameForm = (*binding.forms)[0];
+			auto name = *nameForm.identifier;
+			// A binding without an initializer is left uninitialized, which is what large arrays want.
+			Value *init = nullptr;
+			if (binding.forms->size() == 2) {
+				init = generateForm((*binding.forms)[1]);
+				if (init == nullptr) {
+					// Error.
+					return nullptr;
+				}
+			}
+			Type *type = ((nameForm.typeAnnotation != nullptr)
+			              ? toType(*nameForm.typeAnnotation)
+			              : (init != nullptr) ? init->getType() : nullptr);
+			if (type == nullptr) {
+				// Error.
+				return nullptr;
+			}
+			AllocaInst *alloca = createEntryAlloca(type, name);
+			uint64_t alignment = alignmentOf(type);
+			if (alignment > alloca->getAlign().value()) {
+				alloca->setAlignment(Align(alignment));
+			}
+			if (init != nullptr) {
+				init = coerce(init, type);
+				if (init == nullptr) {
+					// Error.
+					return nullptr;
+				}
+				irBuilder->CreateStore(init, alloca);
+			}
+			shadowed.push_back({name, namedValues.count(name) ? namedValues[name] : nullptr});
+			namedValues[name] = alloca;
+		}
+		Value *value = nullptr;
+		for (std::ptrdiff_t i = 2; i < forms.size(); i++) {
+			value = generateForm(forms[i], tail && (i == forms.size() - 1));
+			if ((value == nullptr) || isTerminated()) {
+				break;
+			}
+		}
+		for (auto binding = shadowed.rbegin(); binding != shadowed.rend(); binding++) {
+			if (binding->second == nullptr) {
+				namedValues.erase(binding->first);
+			}
+			else {
+				namedValues[binding->first] = binding->second;
+			}
+		}
+		return value;
+	}
+
+	// (set name value)
+	Value *generateSet(Parser::Forms forms) {
+		if ((forms.size() != 3) || (forms[1].type != Parser::IDENTIFIER)) {
+			// Error.
+			return nullptr;
+		}
+		auto name = *forms[1].identifier;
+		auto variable = namedValues.find(name);
+		if (variable == namedValues.end()) {
+			std::cout << "Unknown variable " << name << std::endl;
+			// Error.
+			return nullptr;
+		}
+		Value *value = generateForm(forms[2]);
+		if (value == nullptr) {
+			// Error.
+			return nullptr;
+		}
+		value = coerce(value, variable->second->getAllocatedType());
+		if (value == nullptr) {
+			// Error.
+			return nullptr;
+		}
+		irBuilder->CreateStore(value, variable->second);
+		return value;
+	}
+
+	Value *generateCondition(Parser::Form form) {
+		Value *condition = generateForm(form);
+		if ((condition == nullptr) || condition->getType()->isVectorTy()) {
+			// Error.
+			return nullptr;
+		}
+		if (!condition->getType()->isIntegerTy(1)) {
+			condition = irBuilder->CreateICmpNE(condition, Constant::getNullValue(condition->getType()), "loopcond");
+		}
+		return condition;
+	}
+
+	// Generates the body of a loop into the current block. Returns false on error.
+	bool generateLoopBody(Parser::Forms forms, std::ptrdiff_t start, BasicBlock *exitBlock) {
+		loopExits.push_back(exitBlock);
+		bool success = true;
+		for (std::ptrdiff_t i = start; i < forms.size(); i++) {
+			if (generateForm(forms[i]) == nullptr) {
+				success = false;
+				break;
+			}
+			if (isTerminated()) {
+				break;
+			}
+		}
+		loopExits.pop_back();
+		return success;
+	}
+
+	/* Loops are emitted in canonical form so the loop passes apply without any cleanup:
+	   preheader -> header (condition) -> body -> latch -> header, with a single exit from the header. The value of a
+	   loop is always zero. */
+	Value *generateLoop(std::string keyword, Parser::Forms forms) {
+		Function *function = irBuilder->GetInsertBlock()->getParent();
+		BasicBlock *headerBlock = BasicBlock::Create(*llvmContext, keyword + "header", function);
+		BasicBlock *bodyBlock = BasicBlock::Create(*llvmContext, keyword + "body");
+		BasicBlock *latchBlock = BasicBlock::Create(*llvmContext, keyword + "latch");
+		BasicBlock *exitBlock = BasicBlock::Create(*llvmContext, keyword + "exit");
+		AllocaInst *counter = nullptr;
+		Value *end = nullptr;
+		std::string counterName;
+		AllocaInst *shadowed = nullptr;
+		std::ptrdiff_t bodyStart = 1;
+
+		if (keyword == "for") {
+			// (for (name[::type] start end) body...) counts from `start` up to, but not including, `end`.
+			bodyStart = 2;
+			if ((forms.size() < 2) || (forms[1].type != Parser::FORM) || (forms[1].forms->size() != 3)
+			    || ((*forms[1].forms)[0].type != Parser::IDENTIFIER)) {
+				// Error.
+				return nullptr;
+			}
+			auto range = *forms[1].forms;
+			counterName = *range[0].identifier;
+			Value *start = generateForm(range[1]);
+			end = generateForm(range[2]);
+			if ((start == nullptr) || (end == nullptr)) {
+				// Error.
+				return nullptr;
+			}
+			Type *type = (range[0].typeAnnotation != nullptr) ? toType(*range[0].typeAnnotation) : end->getType();
+			if ((type == nullptr) || !type->isIntegerTy()) {
+				// Error.
+				return nullptr;
+			}
+			end = coerce(end, type);
+			counter = createEntryAlloca(type, counterName);
+			irBuilder->CreateStore(coerce(start, type), counter);
+			shadowed = namedValues.count(counterName) ? namedValues[counterName] : nullptr;
+			namedValues[counterName] = counter;
+		}
+		else if (keyword == "while") {
+			// (while condition body...)
+			bodyStart = 2;
+			if (forms.size() < 2) {
+				// Error.
+				return nullptr;
+			}
+		}
+		irBuilder->CreateBr(headerBlock);
+
+		irBuilder->SetInsertPoint(headerBlock);
+		if (keyword == "loop") {
+			// (loop body...) runs until a `break`.
+			irBuilder->CreateBr(bodyBlock);
+		}
+		else {
+			Value *condition = nullptr;
+			if (keyword == "for") {
+				Value *index = irBuilder->CreateLoad(counter->getAllocatedType(), counter, counterName);
+				condition = irBuilder->CreateICmpULT(index, end, "loopcond");
+			}
+			else {
+				condition = generateCondition(forms[1]);
+			}
+			if (condition == nullptr) {
+				// Error.
+				return nullptr;
+			}
+			irBuilder->CreateCondBr(condition, bodyBlock, exitBlock);
+		}
+
+		function->getBasicBlockList().push_back(bodyBlock);
+		irBuilder->SetInsertPoint(bodyBlock);
+		bool success = generateLoopBody(forms, bodyStart, exitBlock);
+		if (!success) {
+			// Error.
+			return nullptr;
+		}
+		if (!isTerminated()) {
+			irBuilder->CreateBr(latchBlock);
+		}
+
+		function->getBasicBlockList().push_back(latchBlock);
+		irBuilder->SetInsertPoint(latchBlock);
+		if (keyword == "for") {
+			Value *index = irBuilder->CreateLoad(counter->getAllocatedType(), counter, counterName);
+			irBuilder->CreateStore(irBuilder->CreateAdd(index, ConstantInt::get(index->getType(), 1), "nextvar"),
+			                       counter);
+			if (shadowed == nullptr) {
+				namedValues.erase(counterName);
+			}
+			else {
+				namedValues[counterName] = shadowed;
+			}
+		}
+		irBuilder->CreateBr(headerBlock);
+
+		function->getBasicBlockList().push_back(exitBlock);
+		irBuilder->SetInsertPoint(exitBlock);
+		return Constant::getNullValue(Type::getInt32Ty(*llvmContext));
+	}
+
+	// (break) leaves the innermost loop.
+	Value *generateBreak(Parser::Forms forms) {
+		if ((forms.size() != 1) || loopExits.empty()) {
+			// Error.
+			return nullptr;
+		}
+		irBuilder->CreateBr(loopExits.back());
+		return Constant::getNullValue(Type::getInt32Ty(*llvmContext));
+	}
+
+	Value *generateProgn(Parser::Forms forms, bool tail) {
+		Value *returnValue = nullptr;
+		for (std::ptrdiff_t i = 1; i < forms.size(); i++) {
+			returnValue = generateForm(forms[i], tail && (i == forms.size() - 1));
+			if (isTerminated()) {
+				break;
+			}
+		}
+		return returnValue;
+	}
+
+	Value *generateIf(Parser::Forms forms, bool tail) {
+		if ((forms.size() != 3) && (forms.size() != 4)) {
+			// Error.
+			return nullptr;
+		}
+		Value *condition = generateForm(forms[1]);
+		if (condition == nullptr) {
+			// Error.
+			return nullptr;
+		}
+		if (condition->getType()->isVectorTy()) {
+			// Error.
+			return nullptr;
+		}
+		if (!condition->getType()->isIntegerTy(1)) {
+			condition = irBuilder->CreateICmpNE(condition, Constant::getNullValue(condition->getType()), "ifcond");
+		}
+		Function *function = irBuilder->GetInsertBlock()->getParent();
+		BasicBlock *thenBlock = BasicBlock::Create(*llvmContext, "then", function);
+		BasicBlock *elseBlock = BasicBlock::Create(*llvmContext, "else");
+		BasicBlock *mergeBlock = BasicBlock::Create(*llvmContext, "ifcont");
+		irBuilder->CreateCondBr(condition, thenBlock, elseBlock);
+
+		irBuilder->SetInsertPoint(thenBlock);
+		Value *thenValue = generateForm(forms[2], tail);
+		if (thenValue == nullptr) {
+			// Error.
+			return nullptr;
+		}
+		if (tail && !isTerminated() && (generateReturn(thenValue) == nullptr)) {
+			// Error.
+			return nullptr;
+		}
+		bool thenFallsThrough = !isTerminated();
+		if (thenFallsThrough) {
+			irBuilder->CreateBr(mergeBlock);
+		}
+		thenBlock = irBuilder->GetInsertBlock();
+
+		function->getBasicBlockList().push_back(elseBlock);
+		irBuilder->SetInsertPoint(elseBlock);
+		Value *elseValue = ((forms.size() == 4)
+		                    ? generateForm(forms[3], tail)
+		                    : Constant::getNullValue(thenValue->getType()));
+		if (elseValue == nullptr) {
+			// Error.
+			return nullptr;
+		}
+		if (tail && !isTerminated() && (generateReturn(elseValue) == nullptr)) {
+			// Error.
+			return nullptr;
+		}
+		bool elseFallsThrough = !isTerminated();
+		if (elseFallsThrough) {
+			elseValue = coerce(elseValue, thenValue->getType());
+			if (elseValue == nullptr) {
+				// Error.
+				return nullptr;
+			}
+			irBuilder->CreateBr(mergeBlock);
+		}
+		elseBlock = irBuilder->GetInsertBlock();
+
+		if (!thenFallsThrough && !elseFallsThrough) {
+			// Both branches returned. Leave the builder in a terminated block so the caller emits nothing more.
+			delete mergeBlock;
+			return thenValue;
+		}
+		function->getBasicBlockList().push_back(mergeBlock);
+		irBuilder->SetInsertPoint(mergeBlock);
+		PHINode *phi = irBuilder->CreatePHI(thenValue->getType(), 2, "iftmp");
+		if (thenFallsThrough) {
+			phi->addIncoming(thenValue, thenBlock);
+		}
+		if (elseFallsThrough) {
+			phi->addIncoming(elseValue, elseBlock);
+		}
+		return phi;
+	}
+
+	// Unsigned operands of different widths are widened to the larger width. A scalar operand of a vector operation is
+	// splatted. Vectors of different lengths are rejected.
+	bool unifyOperands(Value *&left, Value *&right) {
+		if (left->getType()->isVectorTy() && !right->getType()->isVectorTy()) {
+			right = coerce(right, left->getType());
+			return true;
+		}
+		if (right->getType()->isVectorTy() && !left->getType()->isVectorTy()) {
+			left = coerce(left, right->getType());
+			return true;
+		}
+		if (left->getType()->isVectorTy()
+		    && (cast<FixedVectorType>(left->getType())->getNumElements()
+		        != cast<FixedVectorType>(right->getType())->getNumElements())) {
+			std::cout << "Vectors of different lengths" << std::endl;
+			return false;
+		}
+		auto leftWidth = left->getType()->getScalarSizeInBits();
+		auto rightWidth = right->getType()->getScalarSizeInBits();
+		if (leftWidth < rightWidth) {
+			left = coerce(left, right->getType());
+		}
+		else if (rightWidth < leftWidth) {
+			right = coerce(right, left->getType());
+		}
+		return true;
+	}
+
+	bool isOperator(std::string keyword) {
+		static const std::set<std::string> operators = {"+", "-", "*", "/", "%",
+		                                                "=", "/=", "<", ">", "<=", ">="};
+		return operators.count(keyword) != 0;
+	}
+
+	Value *generateOperator(std::string keyword, Parser::Forms forms) {
+		if (forms.size() < 3) {
+			// Error.
+			return nullptr;
+		}
+		bool comparison = !((keyword == "+") || (keyword == "-") || (keyword == "*")
+		                    || (keyword == "/") || (keyword == "%"));
+		if (comparison && (forms.size() != 3)) {
+			// Error.
+			return nullptr;
+		}
+		Value *left = generateForm(forms[1]);
+		for (std::ptrdiff_t i = 2; i < forms.size(); i++) {
+			Value *right = generateForm(forms[i]);
+			if ((left == nullptr) || (right == nullptr)) {
+				// Error.
+				return nullptr;
+			}
+			left = coerce(left, left->getType()->isIntOrIntVectorTy(1) ? right->getType() : left->getType());
+			right = coerce(right, right->getType()->isIntOrIntVectorTy(1) ? left->getType() : right->getType());
+			if (!unifyOperands(left, right)) {
+				// Error.
+				return nullptr;
+			}
+			if (keyword == "+") {
+				left = irBuilder->CreateAdd(left, right, "addtmp");
+			}
+			else if (keyword == "-") {
+				left = irBuilder->CreateSub(left, right, "subtmp");
+			}
+			else if (keyword == "*") {
+				left = irBuilder->CreateMul(left, right, "multmp");
+			}
+			else if (keyword == "/") {
+				left = irBuilder->CreateUDiv(left, right, "divtmp");
+			}
+			else if (keyword == "%") {
+				left = irBuilder->CreateURem(left, right, "remtmp");
+			}
+			else if (keyword == "=") {
+				left = irBuilder->CreateICmpEQ(left, right, "cmptmp");
+			}
+			else if (keyword == "/=") {
+				left = irBuilder->CreateICmpNE(left, right, "cmptmp");
+			}
+			else if (keyword == "<") {
+				left = irBuilder->CreateICmpULT(left, right, "cmptmp");
+			}
+			else if (keyword == ">") {
+				left = irBuilder->CreateICmpUGT(left, right, "cmptmp");
+			}
+			else if (keyword == "<=") {
+				left = irBuilder->CreateICmpULE(left, right, "cmptmp");
+			}
+			else if (keyword == ">=") {
+				left = irBuilder->CreateICmpUGE(left, right, "cmptmp");
+			}
+		}
+		return left;
+	}
+
+	bool isVectorBuiltin(std::string keyword) {
+		static const std::set<std::string> builtins = {"vector", "vec-splat", "vec-ref", "vec-set", "vec-shuffle",
+		                                               "vec-reduce-add", "vec-reduce-mul", "vec-reduce-and",
+		                                               "vec-reduce-or", "vec-reduce-xor", "vec-reduce-min",
+		                                               "vec-reduce-max"};
+		return builtins.count(keyword) != 0;
+	}
+
+	Value *generateVectorBuiltin(std::string keyword, Parser::Forms forms) {
+		if (forms.size() < 2) {
+			// Error.
+			return nullptr;
+		}
+		if (keyword == "vec-shuffle") {
+			// (vec-shuffle a b index...) with constant indices into the concatenation of `a` and `b`.
+			if (forms.size() < 4) {
+				// Error.
+				return nullptr;
+			}
+			Value *left = generateForm(forms[1]);
+			Value *right = generateForm(forms[2]);
+			if ((left == nullptr) || (right == nullptr) || !left->getType()->isVectorTy()) {
+				// Error.
+				return nullptr;
+			}
+			right = coerce(right, left->getType());
+			if (right->getType() != left->getType()) {
+				std::cout << "vec-shuffle operands of different types" << std::endl;
+				// Error.
+				return nullptr;
+			}
+			auto length = cast<FixedVectorType>(left->getType())->getNumElements();
+			std::vector<int> mask;
+			for (std::ptrdiff_t i = 3; i < forms.size(); i++) {
+				if ((forms[i].type != Parser::INTEGER) || (forms[i].integer >= 2 * length)) {
+					// Error.
+					return nullptr;
+				}
+				mask.push_back(forms[i].integer);
+			}
+			return irBuilder->CreateShuffleVector(left, right, mask, "shuffletmp");
+		}
+		std::vector<Value *> operands;
+		for (std::ptrdiff_t i = 1; i < forms.size(); i++) {
+			Value *operand = generateForm(forms[i]);
+			if (operand == nullptr) {
+				// Error.
+				return nullptr;
+			}
+			operands.push_back(operand);
+		}
+		if (keyword == "vector") {
+			// (vector element...) takes its element type from the first element.
+			Type *elementType = operands[0]->getType();
+			if (!elementType->isIntegerTy()) {
+				// Error.
+				return nullptr;
+			}
+			Value *vector = UndefValue::get(FixedVectorType::get(elementType, operands.size()));
+			for (std::ptrdiff_t i = 0; i < operands.size(); i++) {
+				vector = irBuilder->CreateInsertElement(vector, coerce(operands[i], elementType), i, "vectortmp");
+			}
+			return vector;
 		}
-		else if (typeName == "ui16") {
-			return Type::getInt16Ty(*llvmContext);
+		if (keyword == "vec-splat") {
+			// (vec-splat value count)
+			if ((forms.size() != 3) || (forms[2].type != Parser::INTEGER) || (forms[2].integer == 0)
+			    || (forms[2].integer > std::numeric_limits<uint32_t>::max()) || !operands[0]->getType()->isIntegerTy()) {
+				// Error.
+				return nullptr;
+			}
+			return irBuilder->CreateVectorSplat(forms[2].integer, operands[0], "splattmp");
 		}
-		else if (typeName == "ui8") {
-			return Type::getInt8Ty(*llvmContext);
+		Value *vector = operands[0];
+		if (!vector->getType()->isVectorTy()) {
+			// Error.
+			return nullptr;
 		}
-		else {
+		Type *elementType = cast<FixedVectorType>(vector->getType())->getElementType();
+		if (keyword == "vec-ref") {
+			if (operands.size() != 2) {
+				// Error.
+				return nullptr;
+			}
+			return irBuilder->CreateExtractElement(vector, operands[1], "reftmp");
+		}
+		if (keyword == "vec-set") {
+			if (operands.size() != 3) {
+				// Error.
+				return nullptr;
+			}
+			return irBuilder->CreateInsertElement(vector, coerce(operands[2], elementType), operands[1], "settmp");
+		}
+		if (operands.size() != 1) {
+			// Error.
 			return nullptr;
 		}
+		if (keyword == "vec-reduce-add") {
+			return irBuilder->CreateAddReduce(vector);
+		}
+		else if (keyword == "vec-reduce-mul") {
+			return irBuilder->CreateMulReduce(vector);
+		}
+		else if (keyword == "vec-reduce-and") {
+			return irBuilder->CreateAndReduce(vector);
+		}
+		else if (keyword == "vec-reduce-or") {
+			return irBuilder->CreateOrReduce(vector);
+		}
+		else if (keyword == "vec-reduce-xor") {
+			return irBuilder->CreateXorReduce(vector);
+		}
+		else if (keyword == "vec-reduce-min") {
+			return irBuilder->CreateIntMinReduce(vector, false);
+		}
+		else if (keyword == "vec-reduce-max") {
+			return irBuilder->CreateIntMaxReduce(vector, false);
+		}
+		return nullptr;
 	}
 
-	Value *generateForm(Parser::Form form);
-
-	Value *generateInteger(Parser::Form form) {
-		return ConstantInt::get(*llvmContext, APInt(32, form.integer));
+	DIType *toDebugType(Type *type) {
+		if (type->isIntegerTy()) {
+			auto bits = type->getIntegerBitWidth();
+			return diBuilder->createBasicType("ui" + std::to_string(bits), bits, dwarf::DW_ATE_unsigned);
+		}
+		if (type->isPointerTy()) {
+			return diBuilder->createPointerType(toDebugType(type->getPointerElementType()),
+			                                    llvmModule->getDataLayout().getPointerSizeInBits());
+		}
+		if (auto structType = dyn_cast<StructType>(type)) {
+			// Fields are left out. The name is enough to tell records apart in a profile.
+			if (structType->hasName()) {
+				return diBuilder->createUnspecifiedType(structType->getName());
+			}
+		}
+		return diBuilder->createUnspecifiedType("");
 	}
 
-	Value *generateProgn(Parser::Forms forms) {
-		Value *returnValue = nullptr;
-		Function *function = irBuilder->GetInsertBlock()->getParent();
-		BasicBlock *progn = BasicBlock::Create(*llvmContext, "progn", function);
-		BasicBlock *endProgn = BasicBlock::Create(*llvmContext, "prognCont");
-		irBuilder->SetInsertPoint(progn);
-		irBuilder->CreateBr(progn);
-
-		for (std::ptrdiff_t i = 1; i < forms.size(); i++) {
-			returnValue = generateForm(forms[i]);
+	// Attaches a subprogram to `function`, and describes its parameters, which live in `parameterAllocas`.
+	void generateDebugFunction(Function *function, Parser::Form &nameForm) {
+		std::vector<Metadata *> types = {toDebugType(function->getReturnType())};
+		for (auto &arg: function->args()) {
+			types.push_back(toDebugType(arg.getType()));
 		}
-		progn = irBuilder->GetInsertBlock();
-		function->getBasicBlockList().push_back(endProgn);
-		irBuilder->SetInsertPoint(endProgn);
-		return Constant::getNullValue(Type::getInt32Ty(*llvmContext));
+		auto flags = (function->hasLocalLinkage()
+		              ? DISubprogram::SPFlagDefinition | DISubprogram::SPFlagLocalToUnit
+		              : DISubprogram::SPFlagDefinition);
+		debugScope = diBuilder->createFunction(debugFile,
+		                                       function->getName(),
+		                                       StringRef(),
+		                                       debugFile,
+		                                       nameForm.line,
+		                                       diBuilder->createSubroutineType(diBuilder->getOrCreateTypeArray(types)),
+		                                       nameForm.line,
+		                                       DINode::FlagPrototyped,
+		                                       flags);
+		function->setSubprogram(debugScope);
+		auto location = DILocation::get(*llvmContext, nameForm.line, nameForm.column, debugScope);
+		irBuilder->SetCurrentDebugLocation(location);
+		for (std::ptrdiff_t i = 0; i < parameterAllocas.size(); i++) {
+			auto variable = diBuilder->createParameterVariable(debugScope,
+			                                                   function->getArg(i)->getName(),
+			                                                   i + 1,
+			                                                   debugFile,
+			                                                   nameForm.line,
+			                                                   toDebugType(parameterAllocas[i]->getAllocatedType()));
+			diBuilder->insertDeclare(parameterAllocas[i],
+			                         variable,
+			                         diBuilder->createExpression(),
+			                         location,
+			                         irBuilder->GetInsertBlock());
+		}
+	}
+
+	bool isIntrinsicBuiltin(std::string keyword) {
+		static const std::set<std::string> builtins = {"popcount", "clz", "ctz", "rotl", "rotr", "bswap", "prefetch",
+		                                               "likely", "unlikely"};
+		return builtins.count(keyword) != 0;
 	}
 
-	Function *generateExternFunction(std::string keyword, Parser::Forms forms) {
-		if (forms.size() != 3) {
+	/* Operations that map to a single LLVM intrinsic. The bit operations work on integers and integer vectors.
+	   `clz` and `ctz` of zero are the bit width. `(prefetch address [write] [locality])` takes constant flags and
+	   returns the address. `likely` and `unlikely` mark a condition for branch layout and return it unchanged. */
+	Value *generateIntrinsicBuiltin(std::string keyword, Parser::Forms forms) {
+		if (forms.size() < 2) {
 			// Error.
+			return nullptr;
 		}
-		auto nameForm = forms[1];
-		if (nameForm.type != Parser::IDENTIFIER) {
+		Value *operand = generateForm(forms[1]);
+		if (operand == nullptr) {
+			// Error.
+			return nullptr;
+		}
+		if (keyword == "prefetch") {
+			if (!operand->getType()->isPointerTy() || (forms.size() > 4)) {
+				// Error.
+				return nullptr;
+			}
+			// Read, with high temporal locality.
+			uint64_t flags[] = {0, 3};
+			for (std::ptrdiff_t i = 2; i < forms.size(); i++) {
+				if ((forms[i].type != Parser::INTEGER) || (forms[i].integer > ((i == 2) ? 1 : 3))) {
+					// Error.
+					return nullptr;
+				}
+				flags[i - 2] = forms[i].integer;
+			}
+			Value *address = irBuilder->CreateBitCast(operand, Type::getInt8PtrTy(*llvmContext));
+			// The last argument selects the data cache.
+			irBuilder->CreateIntrinsic(Intrinsic::prefetch,
+			                           {address->getType()},
+			                           {address, irBuilder->getInt32(flags[0]), irBuilder->getInt32(flags[1]),
+			                            irBuilder->getInt32(1)});
+			return operand;
+		}
+		if ((keyword == "likely") || (keyword == "unlikely")) {
+			if ((forms.size() != 2) || !operand->getType()->isIntegerTy()) {
+				// Error.
+				return nullptr;
+			}
+			// Expecting 1 or 0 at the operand's own type keeps its value, and a test against zero still gets weights.
+			return irBuilder->CreateIntrinsic(Intrinsic::expect,
+			                                  {operand->getType()},
+			                                  {operand, ConstantInt::get(operand->getType(), keyword == "likely")});
+		}
+		Type *type = operand->getType();
+		if (!type->isIntOrIntVectorTy()) {
 			// Error.
+			return nullptr;
 		}
-		auto name = *nameForm.identifier;
-		auto pattern = forms[2];
-		if (pattern.type != Parser::FORM) {
+		if ((keyword == "rotl") || (keyword == "rotr")) {
+			Value *amount = (forms.size() == 3) ? generateForm(forms[2]) : nullptr;
+			if ((amount == nullptr) || !amount->getType()->isIntOrIntVectorTy()) {
+				// Error.
+				return nullptr;
+			}
+			// A funnel shift of a value with itself is a rotate.
+			return irBuilder->CreateIntrinsic((keyword == "rotl") ? Intrinsic::fshl : Intrinsic::fshr,
+			                                  {type},
+			                                  {operand, operand, coerce(amount, type)});
+		}
+		if (forms.size() != 2) {
 			// Error.
+			return nullptr;
+		}
+		if (keyword == "popcount") {
+			return irBuilder->CreateIntrinsic(Intrinsic::ctpop, {type}, {operand});
+		}
+		if ((keyword == "clz") || (keyword == "ctz")) {
+			return irBuilder->CreateIntrinsic((keyword == "clz") ? Intrinsic::ctlz : Intrinsic::cttz,
+			                                  {type},
+			                                  {operand, irBuilder->getFalse()});
 		}
-		if (pattern.typeAnnotation == nullptr) {
+		if (keyword == "bswap") {
+			if ((type->getScalarSizeInBits() % 16) != 0) {
+				// Error.
+				return nullptr;
+			}
+			return irBuilder->CreateIntrinsic(Intrinsic::bswap, {type}, {operand});
+		}
+		return nullptr;
+	}
+
+	/* Resolves the signature of `(defun name (parameter::type ...)::type ...)` and enters it into the declaration
+	   index. A name may be declared any number of times, but always with the same signature and defined only once. */
+	Function *declareFunction(Parser::Forms forms, bool external) {
+		if ((forms.size() < 3) || (forms[1].type != Parser::IDENTIFIER) || (forms[2].type != Parser::FORM)
+		    || (forms[2].typeAnnotation == nullptr)) {
 			// Error.
+			return nullptr;
 		}
-		auto patternTypeAnnotation = *pattern.typeAnnotation;
-		if (patternTypeAnnotation.type != Parser::IDENTIFIER) {
+		auto name = *forms[1].identifier;
+		auto pattern = forms[2];
+		auto returnType = toType(*pattern.typeAnnotation);
+		if (returnType == nullptr) {
 			// Error.
+			return nullptr;
 		}
-		auto returnType = toType(*patternTypeAnnotation.identifier);
 		auto parameters = *pattern.forms;
 		std::vector<Type *> parameterTypes({});
 		for (auto &parameter: parameters) {
-			if (parameter.typeAnnotation == nullptr) {
+			if ((parameter.type != Parser::IDENTIFIER) || (parameter.typeAnnotation == nullptr)) {
 				// Error.
+				return nullptr;
 			}
-			auto typeAnnotation = *parameter.typeAnnotation;
-			Type *type;
-			if (typeAnnotation.type != Parser::IDENTIFIER) {
+			auto type = toType(*parameter.typeAnnotation);
+			if (type == nullptr) {
 				// Error.
+				return nullptr;
 			}
-			auto typeName = *typeAnnotation.identifier;
-			type = toType(typeName);
 			parameterTypes.push_back(type);
 		}
 		FunctionType *functionType = FunctionType::get(returnType, parameterTypes, false);
-		Function *function = Function::Create(functionType, Function::ExternalLinkage, name, llvmModule.get());
+		bool definition = !external;
 
-		std::ptrdiff_t index = 0;
-		for (auto &arg: function->args()) {
-			auto parameter = parameters[index];
-			if (parameter.type != Parser::IDENTIFIER) {
-				// Error.
+		auto entry = declarations.find(name);
+		if (entry != declarations.end()) {
+			auto &declaration = entry->second;
+			if (declaration.function->getFunctionType() != functionType) {
+				std::cout << "Conflicting declarations of function " << name << std::endl;
+				return nullptr;
 			}
-			auto identifier = *parameter.identifier;
-			arg.setName(identifier);
+			if (definition && declaration.defined) {
+				std::cout << "Redefinition of function " << name << std::endl;
+				return nullptr;
+			}
+			declaration.external |= external;
+			declaration.defined |= definition;
+			return declaration.function;
 		}
 
+		Function *function = Function::Create(functionType, Function::ExternalLinkage, name, llvmModule.get());
+		std::ptrdiff_t index = 0;
+		for (auto &arg: function->args()) {
+			arg.setName(*parameters[index].identifier);
+			index++;
+		}
+		declarations[name] = {function, external, definition};
 		return function;
 	}
 
+	// Gives functions that are never declared `extern` internal linkage and the fast calling convention.
+	void applyLinkage() {
+		for (auto &entry: declarations) {
+			auto &declaration = entry.second;
+			if (declaration.defined && !declaration.external && (entry.first != "main")) {
+				declaration.function->setLinkage(Function::InternalLinkage);
+				declaration.function->setCallingConv(CallingConv::Fast);
+			}
+		}
+	}
+
 	Value *generateExtern(std::string keyword, Parser::Forms forms) {
 		Value *value = nullptr;
 		if (forms.size() != 1) {
@@ -151,7 +1799,7 @@ namespace Backend {
 			}
 			auto keyword = *keywordForm.identifier;
 			if (keyword == "defun") {
-				value = generateExternFunction(keyword, prototype);
+				value = declareFunction(prototype, true);
 			}
 			else {
 				// Error.
@@ -160,15 +1808,17 @@ namespace Backend {
 		return value;
 	}
 
-	Value *generateCall(std::string name, Parser::Forms forms) {
-		Function *calleeFunction = llvmModule->getFunction(name);
-		if (calleeFunction == nullptr) {
-			// Error.
+	Value *generateCall(std::string name, Parser::Forms forms, bool tail) {
+		auto declaration = declarations.find(name);
+		if (declaration == declarations.end()) {
+			std::cout << "Unknown function " << name << std::endl;
 			return nullptr;
 		}
 		else {
+			Function *calleeFunction = declaration->second.function;
 			if (calleeFunction->arg_size() != (forms.size() - 1)) {
 				// Error.
+				return nullptr;
 			}
 			std::vector<Value *> args;
 			for (std::ptrdiff_t i = 1, top = forms.size(); i < top; i++){
@@ -177,11 +1827,53 @@ namespace Backend {
 				if (arg == nullptr) {
 					std::cout << "generateCall arg null" << std::endl;
 					// Error.
+					return nullptr;
+				}
+				arg = coerce(arg, calleeFunction->getArg(i - 1)->getType());
+				if (arg == nullptr) {
+					// Error.
+					return nullptr;
 				}
 				args.push_back(arg);
 			}
-			return irBuilder->CreateCall(calleeFunction, args, "calltmp");
+			Function *function = irBuilder->GetInsertBlock()->getParent();
+			if (tail && (calleeFunction == function)) {
+				// Self tail call. All arguments are evaluated before any parameter is overwritten.
+				for (std::ptrdiff_t i = 0; i < args.size(); i++) {
+					irBuilder->CreateStore(args[i], parameterAllocas[i]);
+				}
+				irBuilder->CreateBr(recurBlock);
+				return UndefValue::get(function->getReturnType());
+			}
+			CallInst *call = irBuilder->CreateCall(calleeFunction, args, "calltmp");
+			call->setCallingConv(calleeFunction->getCallingConv());
+			if (tail) {
+				// `musttail` is only legal when the prototypes and calling conventions match exactly.
+				if (guaranteedTailCalls
+				    && (calleeFunction->getFunctionType() == function->getFunctionType())
+				    && (calleeFunction->getCallingConv() == function->getCallingConv())) {
+					call->setTailCallKind(CallInst::TCK_MustTail);
+				}
+				else {
+					call->setTailCallKind(CallInst::TCK_Tail);
+				}
+				if (generateReturn(call) == nullptr) {
+					// Error.
+					return nullptr;
+				}
+			}
+			return call;
+		}
+	}
+
+	uint64_t countForms(Parser::Form &form) {
+		uint64_t count = 1;
+		if (form.type == Parser::FORM) {
+			for (auto &subform: *form.forms) {
+				count += countForms(subform);
+			}
 		}
+		return count;
 	}
 
 	Function *generateFunction(std::string keyword, Parser::Forms forms) {
@@ -194,56 +1886,181 @@ namespace Backend {
 			// Error.
 		}
 		auto name = *nameForm.identifier;
-		// Bug: Type of declaration may not match type of definition.
-		Function *function = llvmModule->getFunction(name);
-		if (function == nullptr) {
-			function = generateExternFunction(keyword, forms);
-		}
-		if (function == nullptr) {
-			// Error.
+		// Top level functions were declared before any body was lowered. Any other function is declared here.
+		Function *function = nullptr;
+		auto declaration = declarations.find(name);
+		if ((declaration != declarations.end()) && declaration->second.defined && declaration->second.function->empty()) {
+			function = declaration->second.function;
 		}
-		if (!function->empty()) {
-			// Error.
+		else {
+			function = declareFunction(forms, false);
+			if (function == nullptr) {
+				return nullptr;
+			}
+			applyLinkage();
 		}
 		BasicBlock *functionBlock = BasicBlock::Create(*llvmContext, "entry", function);
 		irBuilder->SetInsertPoint(functionBlock);
 
-		for (std::ptrdiff_t i = 1; i < forms.size(); i++) {
-			value = generateForm(forms[i]);
+		namedValues.clear();
+		parameterAllocas.clear();
+		frameAddressTaken = false;
+		for (auto &arg: function->args()) {
+			AllocaInst *alloca = irBuilder->CreateAlloca(arg.getType(), nullptr, arg.getName());
+			irBuilder->CreateStore(&arg, alloca);
+			namedValues[std::string(arg.getName())] = alloca;
+			parameterAllocas.push_back(alloca);
+		}
+		if (costReport) {
+			uint64_t count = 1;
+			for (auto &form: forms) {
+				count += countForms(form);
+			}
+			astNodeCounts[function] = count;
+		}
+		// Bilby has no exceptions, so no unwind tables or personality routines are needed.
+		function->addFnAttr(Attribute::NoUnwind);
+		if (optimizationGoal != SPEED) {
+			function->addFnAttr(Attribute::OptimizeForSize);
+		}
+		if (optimizationGoal == MIN_SIZE) {
+			function->addFnAttr(Attribute::MinSize);
+		}
+		if (freestanding) {
+			function->addFnAttr("no-builtins");
+		}
+		if (textSection != "") {
+			function->setSection(textSection);
+		}
+		auto savedLocation = irBuilder->getCurrentDebugLocation();
+		auto savedScope = debugScope;
+		if (diBuilder != nullptr) {
+			generateDebugFunction(function, nameForm);
+		}
+		recurBlock = BasicBlock::Create(*llvmContext, "body", function);
+		irBuilder->CreateBr(recurBlock);
+		irBuilder->SetInsertPoint(recurBlock);
+
+		// forms[1] is the name and forms[2] is the parameter list.
+		for (std::ptrdiff_t i = 3; i < forms.size(); i++) {
+			value = generateForm(forms[i], i == forms.size() - 1);
+			if ((value == nullptr) || isTerminated()) {
+				break;
+			}
+		}
+		irBuilder->SetCurrentDebugLocation(savedLocation);
+		debugScope = savedScope;
+		if ((value != nullptr) && !isTerminated()) {
+			value = generateReturn(value);
 		}
 		if (value == nullptr) {
-			function->eraseFromParent();
+			// Other functions may already call this one, so only the body is removed.
+			function->deleteBody();
 			// Error.
 			return nullptr;
 		}
-		irBuilder->CreateRet(value);
+		if (frameAddressTaken) {
+			// A pointer into this frame may reach any call, even through a variable, so no call may be a tail call.
+			for (auto &block: *function) {
+				for (auto &instruction: block) {
+					if (auto *call = dyn_cast<CallInst>(&instruction)) {
+						call->setTailCallKind(CallInst::TCK_None);
+					}
+				}
+			}
+		}
 		verifyFunction(*function);
-		llvmFpm->run(*function);
 		return function;
 	}
 
+	// Returns the keyword of a form such as `(defun ...)`, or "" if it has none.
+	std::string formKeyword(Parser::Form &form) {
+		if ((form.type != Parser::FORM) || (form.forms->size() == 0) || ((*form.forms)[0].type != Parser::IDENTIFIER)) {
+			return "";
+		}
+		return *(*form.forms)[0].identifier;
+	}
+
+	/* Declares everything at the top level before lowering any function body, so that definitions may appear in
+	   any order. Records come first since signatures may refer to them. */
+	bool declareToplevel(Parser::Forms &forms) {
+		bool valid = true;
+		// Every record is named before any is defined, so fields may refer to records defined later.
+		for (std::ptrdiff_t i = 1; i < forms.size(); i++) {
+			if (formKeyword(forms[i]) != "defstruct") {
+				continue;
+			}
+			auto &structForms = *forms[i].forms;
+			if ((structForms.size() < 2) || (structForms[1].type != Parser::IDENTIFIER)) {
+				// Error.
+				valid = false;
+				continue;
+			}
+			auto name = *structForms[1].identifier;
+			if (structDefinitions.count(name) != 0) {
+				std::cout << "Redefinition of struct " << name << std::endl;
+				valid = false;
+				continue;
+			}
+			structDefinitions[name].type = StructType::create(*llvmContext, name);
+			pendingStructs[name] = structForms;
+		}
+		for (std::ptrdiff_t i = 1; i < forms.size(); i++) {
+			if ((formKeyword(forms[i]) == "defstruct") && ((*forms[i].forms).size() >= 2)
+			    && ((*forms[i].forms)[1].type == Parser::IDENTIFIER)
+			    && (pendingStructs.count(*(*forms[i].forms)[1].identifier) != 0)) {
+				valid &= (generateStruct(*forms[i].forms) != nullptr);
+			}
+		}
+		for (std::ptrdiff_t i = 1; i < forms.size(); i++) {
+			auto keyword = formKeyword(forms[i]);
+			if (keyword == "extern") {
+				valid &= (generateExtern(keyword, *forms[i].forms) != nullptr);
+			}
+			else if (keyword == "defun") {
+				valid &= (declareFunction(*forms[i].forms, false) != nullptr);
+			}
+		}
+		applyLinkage();
+		return valid;
+	}
+
 	Value *generateToplevel(std::string keyword, Parser::Forms forms) {
 		Value *value = nullptr;
 		if (forms.size() < 1) {
 			// Error.
 		}
+		if (!declareToplevel(forms)) {
+			// Nothing is lowered, and no output is written.
+			programRejected = true;
+			return nullptr;
+		}
 		for (std::ptrdiff_t i = 1; i < forms.size(); i++) {
+			auto kind = formKeyword(forms[i]);
+			if ((kind == "defstruct") || (kind == "extern")) {
+				// Already done by the declaration pass.
+				continue;
+			}
 			value = generateForm(forms[i]);
 			if (value == nullptr) {
 				std::cout << "Form returned null." << std::endl;
+				programRejected = true;
 			}
-			else {
+			else if (!quiet) {
 				value->print(errs());
 			}
 		}
 		return value;
 	}
 
-	Value *generateForm(Parser::Form form) {
+	Value *generateFormWithoutLocation(Parser::Form form, bool tail) {
 		Value *value = nullptr;
 		if (form.type == Parser::INTEGER) {
 			value = generateInteger(form);
 		}
+		else if (form.type == Parser::IDENTIFIER) {
+			value = generateVariable(form);
+		}
 		else if (form.type == Parser::FORM) {
 			if (form.forms->size() > 0) {
 				auto forms = *form.forms;
@@ -254,7 +2071,46 @@ namespace Backend {
 						value = generateToplevel(keyword, forms);
 					}
 					else if (keyword == "progn") {
-						value = generateProgn(forms);
+						value = generateProgn(forms, tail);
+					}
+					else if (keyword == "if") {
+						value = generateIf(forms, tail);
+					}
+					else if (keyword == "let") {
+						value = generateLet(forms, tail);
+					}
+					else if (keyword == "set") {
+						value = generateSet(forms);
+					}
+					else if ((keyword == "while") || (keyword == "for") || (keyword == "loop")) {
+						value = generateLoop(keyword, forms);
+					}
+					else if (keyword == "break") {
+						value = generateBreak(forms);
+					}
+					else if (keyword == "defstruct") {
+						value = generateStruct(forms);
+					}
+					else if (keyword == "get") {
+						value = generateGet(forms);
+					}
+					else if (keyword == "put") {
+						value = generatePut(forms);
+					}
+					else if (keyword == "ref") {
+						value = generateRef(forms);
+					}
+					else if (keyword == "load") {
+						value = generateLoad(forms);
+					}
+					else if (keyword == "store") {
+						value = generateStore(forms);
+					}
+					else if (isAllocatorBuiltin(keyword)) {
+						value = generateAllocatorBuiltin(keyword, forms);
+					}
+					else if (isAtomicBuiltin(keyword)) {
+						value = generateAtomicBuiltin(keyword, forms);
 					}
 					else if (keyword == "extern") {
 						value = generateExtern(keyword, forms);
@@ -262,8 +2118,17 @@ namespace Backend {
 					else if (keyword == "defun") {
 						value = generateFunction(keyword, forms);
 					}
+					else if (isOperator(keyword)) {
+						value = generateOperator(keyword, forms);
+					}
+					else if (isVectorBuiltin(keyword)) {
+						value = generateVectorBuiltin(keyword, forms);
+					}
+					else if (isIntrinsicBuiltin(keyword)) {
+						value = generateIntrinsicBuiltin(keyword, forms);
+					}
 					else {
-						value = generateCall(keyword, forms);
+						value = generateCall(keyword, forms, tail);
 					}
 				}
 				else {
@@ -274,58 +2139,306 @@ namespace Backend {
 		return value;
 	}
 
-	void generate(Parser::Form form) {
-		std::cout << "--------------------------------------------------------------------------------" << std::endl;
-		llvmContext = std::make_unique<LLVMContext>();
-		llvmModule = std::make_unique<Module>("Bilby", *llvmContext);
-		irBuilder = std::make_unique<IRBuilder<>>(*llvmContext);
-		llvmFpm = std::make_unique<legacy::FunctionPassManager>(llvmModule.get());
-		llvmFpm->add(createInstructionCombiningPass());
-		llvmFpm->add(createReassociatePass());
-		llvmFpm->add(createGVNPass());
-		llvmFpm->add(createCFGSimplificationPass());
-		llvmFpm->doInitialization();
-		auto value = generateForm(form);
-		std::cout << "--------------------------------------------------------------------------------" << std::endl;
-		if (value == nullptr) {
-			std::cout << "Top level returned null." << std::endl;
-		}
-		else {
-			value->print(errs());
+	Value *generateForm(Parser::Form form, bool tail) {
+		Value *value = nullptr;
+		// Instructions are attributed to the innermost form that generated them.
+		auto savedLocation = irBuilder->getCurrentDebugLocation();
+		if ((debugScope != nullptr) && (form.line != 0)) {
+			irBuilder->SetCurrentDebugLocation(DILocation::get(*llvmContext, form.line, form.column, debugScope));
 		}
-		auto targetTriple = sys::getDefaultTargetTriple();
+		value = generateFormWithoutLocation(form, tail);
+		irBuilder->SetCurrentDebugLocation(savedLocation);
+		return value;
+	}
+
+	void initializeTargets() {
 		InitializeAllTargetInfos();
 		InitializeAllTargets();
 		InitializeAllTargetMCs();
 		InitializeAllAsmParsers();
 		InitializeAllAsmPrinters();
+	}
+
+	uint64_t countInstructions() {
+		uint64_t count = 0;
+		for (auto &function: *llvmModule) {
+			count += function.getInstructionCount();
+		}
+		return count;
+	}
+
+	double secondsSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Reads the size of every function's symbol from the emitted object.
+	void measureMachineCode(StringRef object, std::vector<FunctionCost> &costs) {
+		auto objectFile = object::ObjectFile::createObjectFile(MemoryBufferRef(object, "output"));
+		if (!objectFile) {
+			consumeError(objectFile.takeError());
+			return;
+		}
+		std::unordered_map<std::string, uint64_t> sizes;
+		for (auto &symbolSize: object::computeSymbolSizes(**objectFile)) {
+			auto name = symbolSize.first.getName();
+			if (name) {
+				sizes[name->str()] = symbolSize.second;
+			}
+			else {
+				consumeError(name.takeError());
+			}
+		}
+		Mangler mangler;
+		for (auto &cost: costs) {
+			std::string symbol;
+			raw_string_ostream symbolStream(symbol);
+			mangler.getNameWithPrefix(symbolStream, llvmModule->getFunction(cost.name), false);
+			symbolStream.flush();
+			cost.machineCodeBytes = sizes[symbol];
+		}
+	}
+
+	Statistics generate(Parser::Form form, Options options) {
+		Statistics statistics;
+		quiet = options.quiet;
+		optimizationGoal = options.optimizationGoal;
+		freestanding = options.freestanding;
+		textSection = options.textSection;
+		costReport = options.costReport;
+		astNodeCounts.clear();
+		if (!quiet) {
+			std::cout << "--------------------------------------------------------------------------------" << std::endl;
+		}
+		llvmContext = std::make_unique<LLVMContext>();
+		structDefinitions.clear();
+		fieldIndices.clear();
+		soaArrayTypes.clear();
+		soaArrays.clear();
+		typeAlignments.clear();
+		declarations.clear();
+		pendingStructs.clear();
+		programRejected = false;
+		llvmModule = std::make_unique<Module>("Bilby", *llvmContext);
+		llvmModule->setSourceFileName(options.sourceFilename);
+		auto targetTriple = ((options.targetTriple != "")
+		                     ? Triple::normalize(options.targetTriple)
+		                     : sys::getDefaultTargetTriple());
+		initializeTargets();
 		std::string errorString;
 		auto target = TargetRegistry::lookupTarget(targetTriple, errorString);
 		if (target == nullptr) {
 			errs() << errorString;
-			return;
+			return statistics;
+		}
+		auto cpu = options.cpu;
+		auto features = options.features;
+		if (cpu == "native") {
+			// Use every vector extension the host has.
+			cpu = sys::getHostCPUName().str();
+			StringMap<bool> hostFeatures;
+			if (sys::getHostCPUFeatures(hostFeatures)) {
+				SubtargetFeatures subtargetFeatures(features);
+				for (auto &feature: hostFeatures) {
+					subtargetFeatures.AddFeature(feature.first(), feature.second);
+				}
+				features = subtargetFeatures.getString();
+			}
+		}
+		if (options.longCalls) {
+			SubtargetFeatures subtargetFeatures(features);
+			subtargetFeatures.AddFeature("long-calls");
+			features = subtargetFeatures.getString();
+		}
+		{
+			// Before ARMv6, and on the smallest M profile cores, unaligned accesses fault or rotate the data. Packed
+			// records are then accessed a byte at a time.
+			Triple triple(targetTriple);
+			auto archName = triple.getArchName();
+			if ((triple.isARM() || triple.isThumb())
+			    && ((ARM::parseArchVersion(archName) < 6)
+			        || (ARM::parseArch(archName) == ARM::ArchKind::ARMV6M)
+			        || (ARM::parseArch(archName) == ARM::ArchKind::ARMV8MBaseline))) {
+				SubtargetFeatures subtargetFeatures(features);
+				subtargetFeatures.AddFeature("strict-align");
+				features = subtargetFeatures.getString();
+			}
 		}
-		auto cpu = "generic";
-		auto features = "";
+		guaranteedTailCalls = !Triple(targetTriple).isThumb() && !StringRef(features).contains("+thumb-mode");
 		TargetOptions targetOptions;
+		targetOptions.FunctionSections = options.functionSections;
 		auto relocModel = Optional<Reloc::Model>();
+		// System compilers link position independent executables by default, whether bilby or the user runs them.
+		// Freestanding code and targets without an operating system keep the target's default.
+		if (options.link || (!options.freestanding && (Triple(targetTriple).getOS() != Triple::UnknownOS))) {
+			relocModel = Reloc::PIC_;
+		}
 		auto targetMachine = target->createTargetMachine(targetTriple, cpu, features, targetOptions, relocModel);
 		llvmModule->setDataLayout(targetMachine->createDataLayout());
 		llvmModule->setTargetTriple(targetTriple);
-		auto filename = "output.o";
-		std::error_code errorCode;
-		raw_fd_ostream dest(filename, errorCode, sys::fs::OF_None);
-		if (errorCode) {
-			errs() << "Could not open file: " << errorCode.message();
-			return;
+		irBuilder = std::make_unique<IRBuilder<>>(*llvmContext);
+		// Without a C library, no call may be treated as, or turned into, a call to a library function.
+		TargetLibraryInfoImpl targetLibraryInfo(Triple{targetTriple});
+		if (freestanding) {
+			targetLibraryInfo.disableAllFunctions();
 		}
-		legacy::PassManager pass;
-		auto fileType = CGFT_ObjectFile;
-		if (targetMachine->addPassesToEmitFile(pass, dest, nullptr, fileType)) {
-			errs() << "TargetMachine can emit a file of this type.";
-			return;
+		llvmFpm = std::make_unique<legacy::FunctionPassManager>(llvmModule.get());
+		llvmFpm->add(new TargetLibraryInfoWrapperPass(targetLibraryInfo));
+		// The vectorizers and the unroller need the target's cost model.
+		llvmFpm->add(createTargetTransformInfoWrapperPass(targetMachine->getTargetIRAnalysis()));
+		// Turns `likely` and `unlikely` into branch weights.
+		llvmFpm->add(createLowerExpectIntrinsicPass());
+		llvmFpm->add(createPromoteMemoryToRegisterPass());
+		llvmFpm->add(createTailCallEliminationPass());
+		llvmFpm->add(createInstructionCombiningPass());
+		llvmFpm->add(createReassociatePass());
+		llvmFpm->add(createGVNPass());
+		llvmFpm->add(createCFGSimplificationPass());
+		llvmFpm->add(createLoopRotatePass());
+		llvmFpm->add(createLICMPass());
+		llvmFpm->add(createIndVarSimplifyPass());
+		// Unrolling and vectorization trade code size for speed.
+		if (optimizationGoal == SPEED) {
+			llvmFpm->add(createSimpleLoopUnrollPass());
+			llvmFpm->add(createLoopVectorizePass());
+			llvmFpm->add(createInstructionCombiningPass());
+			llvmFpm->add(createSLPVectorizerPass());
+			llvmFpm->add(createLoopUnrollPass());
+		}
+		llvmFpm->add(createInstructionCombiningPass());
+		llvmFpm->add(createLICMPass());
+		llvmFpm->add(createCFGSimplificationPass());
+		llvmFpm->doInitialization();
+		diBuilder.reset();
+		debugFile = nullptr;
+		debugScope = nullptr;
+		if (options.debugInfo) {
+			diBuilder = std::make_unique<DIBuilder>(*llvmModule);
+			std::string sourceFilename = options.sourceFilename;
+			debugFile = diBuilder->createFile(sys::path::filename(sourceFilename), sys::path::parent_path(sourceFilename));
+			// DWARF has no language code for Bilby. C is close enough for debuggers and profilers.
+			diBuilder->createCompileUnit(dwarf::DW_LANG_C, debugFile, "bilby", true, "", 0);
+			llvmModule->addModuleFlag(Module::Warning, "Debug Info Version", DEBUG_METADATA_VERSION);
+			llvmModule->addModuleFlag(Module::Warning, "Dwarf Version", 4);
+		}
+		auto phaseStart = std::chrono::steady_clock::now();
+		auto value = generateForm(form);
+		if (diBuilder != nullptr) {
+			diBuilder->finalize();
+		}
+		statistics.lowerSeconds = secondsSince(phaseStart);
+		if (programRejected) {
+			std::cout << "Compilation failed. No output written." << std::endl;
+			return statistics;
+		}
+		statistics.instructionsBeforeOptimization = countInstructions();
+		if (!quiet) {
+			std::cout << "--------------------------------------------------------------------------------" << std::endl;
+		}
+		if (value == nullptr) {
+			std::cout << "Top level returned null." << std::endl;
+		}
+		else if (!quiet) {
+			value->print(errs());
+		}
+		phaseStart = std::chrono::steady_clock::now();
+		// Instrumentation and annotation must see the same CFG, so profiling runs before any optimization.
+		if (options.profileGenerate || (options.profileUse != "")) {
+			legacy::PassManager profilePasses;
+			if (options.profileGenerate) {
+				InstrProfOptions instrProfOptions;
+				instrProfOptions.InstrProfileOutput = options.profileGenerateFile;
+				profilePasses.add(createPGOInstrumentationGenLegacyPass());
+				profilePasses.add(createInstrProfilingLegacyPass(instrProfOptions));
+			}
+			else {
+				profilePasses.add(createPGOInstrumentationUseLegacyPass(options.profileUse));
+			}
+			profilePasses.run(*llvmModule);
+			if (options.profileGenerate) {
+				// The profile writer lives in a static library, so something has to pull it in.
+				auto runtimeHook = new GlobalVariable(*llvmModule, Type::getInt32Ty(*llvmContext), false,
+				                                      GlobalValue::ExternalLinkage, nullptr, "__llvm_profile_runtime");
+				auto runtimeUser = Function::Create(FunctionType::get(Type::getInt32Ty(*llvmContext), false),
+				                                    Function::LinkOnceODRLinkage, "__llvm_profile_runtime_user",
+				                                    llvmModule.get());
+				runtimeUser->setVisibility(GlobalValue::HiddenVisibility);
+				runtimeUser->addFnAttr(Attribute::NoUnwind);
+				irBuilder->SetInsertPoint(BasicBlock::Create(*llvmContext, "entry", runtimeUser));
+				irBuilder->CreateRet(irBuilder->CreateLoad(Type::getInt32Ty(*llvmContext), runtimeHook));
+				appendToUsed(*llvmModule, {runtimeUser});
+			}
+		}
+		for (auto &function: *llvmModule) {
+			if (!function.isDeclaration()) {
+				if (costReport) {
+					FunctionCost cost;
+					cost.name = function.getName().str();
+					auto astNodes = astNodeCounts.find(&function);
+					cost.synthetic = (astNodes == astNodeCounts.end());
+					cost.astNodes = cost.synthetic ? 0 : astNodes->second;
+					cost.instructionsBeforeOptimization = function.getInstructionCount();
+					auto functionStart = std::chrono::steady_clock::now();
+					llvmFpm->run(function);
+					cost.optimizeSeconds = secondsSince(functionStart);
+					cost.instructionsAfterOptimization = function.getInstructionCount();
+					statistics.functionCosts.push_back(cost);
+				}
+				else {
+					llvmFpm->run(function);
+				}
+				statistics.functions++;
+			}
+		}
+		statistics.optimizeSeconds = secondsSince(phaseStart);
+		statistics.instructionsAfterOptimization = countInstructions();
+		phaseStart = std::chrono::steady_clock::now();
+		// Everything is emitted into memory first, so linking never touches the disk.
+		SmallVector<char, 0> buffer;
+		raw_svector_ostream bufferStream(buffer);
+		if (options.emitType == BITCODE) {
+			WriteBitcodeToFile(*llvmModule, bufferStream);
+		}
+		else if (options.emitType == THINLTO_BITCODE) {
+			// The summary lets the thin link import and internalize across modules without loading their bodies.
+			ProfileSummaryInfo profileSummary(*llvmModule);
+			ModuleSummaryIndex summary = buildModuleSummaryIndex(*llvmModule, nullptr, &profileSummary);
+			WriteBitcodeToFile(*llvmModule, bufferStream, false, &summary);
+		}
+		else {
+			legacy::PassManager pass;
+			pass.add(new TargetLibraryInfoWrapperPass(targetLibraryInfo));
+			auto fileType = CGFT_ObjectFile;
+			if (targetMachine->addPassesToEmitFile(pass, bufferStream, nullptr, fileType)) {
+				errs() << "TargetMachine can emit a file of this type.";
+				return statistics;
+			}
+			pass.run(*llvmModule);
+			if (costReport) {
+				measureMachineCode(StringRef(buffer.data(), buffer.size()), statistics.functionCosts);
+			}
+		}
+		if (options.link && (options.emitType == OBJECT)) {
+			if (!Linker::link(StringRef(buffer.data(), buffer.size()), options.linkerOptions)) {
+				return statistics;
+			}
+		}
+		else {
+			std::string filename = ((options.outputFilename != "")
+			                        ? options.outputFilename
+			                        : (options.emitType == OBJECT)
+			                        ? "output.o"
+			                        : "output.bc");
+			std::error_code errorCode;
+			raw_fd_ostream dest(filename, errorCode, sys::fs::OF_None);
+			if (errorCode) {
+				errs() << "Could not open file: " << errorCode.message();
+				return statistics;
+			}
+			dest << StringRef(buffer.data(), buffer.size());
+			dest.flush();
 		}
-		pass.run(*llvmModule);
-		dest.flush();
+		statistics.emitSeconds = secondsSince(phaseStart);
+		statistics.written = true;
+		return statistics;
 	}
 }
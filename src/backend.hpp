@@ -1,7 +1,91 @@
 #pragma once
 
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "linker.hpp"
 #include "parser.hpp"
 
 namespace Backend {
-	void generate(Parser::Form form);
+	enum EmitType {
+		OBJECT,
+		BITCODE,
+		// Bitcode with a module summary, for linking with ThinLTO.
+		THINLTO_BITCODE
+	};
+
+	enum OptimizationGoal {
+		SPEED,
+		// -Os: Avoid optimizations that grow code.
+		SIZE,
+		// -Oz: Make code as small as possible, even when it becomes slower.
+		MIN_SIZE
+	};
+
+	struct Options {
+		EmitType emitType = OBJECT;
+		// Empty means output.o or output.bc.
+		std::string outputFilename = "";
+		// Link the object in memory instead of writing it. The output file is then the linked program.
+		bool link = false;
+		Linker::Options linkerOptions;
+		// Used to give internal functions unique identities across modules.
+		std::string sourceFilename = "";
+		// Empty means the host, e.g. "armv4t-none-eabi" or "thumbv4t-none-eabi" for a cross compile.
+		std::string targetTriple = "";
+		// "native" selects the host CPU and all of its features.
+		std::string cpu = "generic";
+		// Comma separated, e.g. "+avx2,+fma".
+		std::string features = "";
+		// Instrument functions so running the program writes a raw profile to `profileGenerateFile`. `%p` is replaced
+		// with the process ID.
+		bool profileGenerate = false;
+		std::string profileGenerateFile = "default.profraw";
+		// Indexed profile (from `llvm-profdata merge`) used to annotate branch weights and entry counts.
+		std::string profileUse = "";
+		OptimizationGoal optimizationGoal = SPEED;
+		// Assume no C library: calls are never recognized as or turned into library functions.
+		bool freestanding = false;
+		// Put each function in its own section so the linker can drop unused ones.
+		bool functionSections = false;
+		// Section for every function, e.g. ".iwram" on the Game Boy Advance. Empty means the default.
+		std::string textSection = "";
+		// Call through a register so the callee may be anywhere in memory and in either the ARM or Thumb instruction
+		// set. ARM targets only.
+		bool longCalls = false;
+		// Emit DWARF compile units, subprograms and line locations.
+		bool debugInfo = false;
+		// Measure the cost of every function. See `Statistics::functionCosts`.
+		bool costReport = false;
+		// Suppress the IR dumps.
+		bool quiet = false;
+	};
+
+	struct FunctionCost {
+		std::string name;
+		uint64_t astNodes = 0;
+		// Generated by the compiler, such as thread entry points, so it has no AST nodes.
+		bool synthetic = false;
+		uint64_t instructionsBeforeOptimization = 0;
+		uint64_t instructionsAfterOptimization = 0;
+		double optimizeSeconds = 0;
+		// Size of the function's symbol in the object. 0 when emitting bitcode.
+		uint64_t machineCodeBytes = 0;
+	};
+
+	struct Statistics {
+		double lowerSeconds = 0;
+		double optimizeSeconds = 0;
+		double emitSeconds = 0;
+		uint64_t functions = 0;
+		uint64_t instructionsBeforeOptimization = 0;
+		uint64_t instructionsAfterOptimization = 0;
+		// One entry per defined function, in module order. Only filled in with `Options::costReport`.
+		std::vector<FunctionCost> functionCosts;
+		// False if the output could not be written or linked.
+		bool written = false;
+	};
+
+	void initializeTargets();
+	Statistics generate(Parser::Form form, Options options);
 }
@@ -0,0 +1,67 @@
+#include "linker.hpp"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace Linker {
+	using namespace llvm;
+
+	/* Links an object held in memory. LLD is not available as a library in every LLVM installation, so linking goes
+	   through the system compiler driver. The object is handed over through an anonymous in-memory file that the
+	   driver inherits, so nothing is written to disk and parallel builds cannot collide on a temporary name. */
+	bool link(StringRef object, Options options) {
+		auto driver = sys::findProgramByName(options.driver);
+		if (!driver) {
+			errs() << "Could not find linker driver " << options.driver << ": " << driver.getError().message() << "\n";
+			return false;
+		}
+
+		int fd = memfd_create("bilby-object", 0);
+		SmallString<128> temporaryPath;
+		std::string objectPath;
+		if (fd >= 0) {
+			objectPath = "/proc/self/fd/" + std::to_string(fd);
+		}
+		else {
+			// No memfd support. Fall back to a uniquely named temporary file.
+			if (auto errorCode = sys::fs::createTemporaryFile("bilby", "o", fd, temporaryPath)) {
+				errs() << "Could not create temporary object: " << errorCode.message() << "\n";
+				return false;
+			}
+			objectPath = std::string(temporaryPath);
+		}
+		{
+			raw_fd_ostream stream(fd, false);
+			stream << object;
+			stream.flush();
+			if (stream.has_error()) {
+				errs() << "Could not write object: " << stream.error().message() << "\n";
+				close(fd);
+				return false;
+			}
+		}
+
+		std::vector<StringRef> args = {options.driver, objectPath};
+		for (auto &argument: options.arguments) {
+			args.push_back(argument);
+		}
+		if (options.outputType == SHARED_LIBRARY) {
+			args.push_back("-shared");
+		}
+		args.push_back("-o");
+		args.push_back(options.outputFilename);
+		std::string errorMessage;
+		int result = sys::ExecuteAndWait(*driver, args, None, {}, 0, 0, &errorMessage);
+		close(fd);
+		if (!temporaryPath.empty()) {
+			sys::fs::remove(temporaryPath);
+		}
+		if (result != 0) {
+			errs() << "Linking failed" << (errorMessage.empty() ? "" : ": ") << errorMessage << "\n";
+			return false;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <llvm/ADT/StringRef.h>
+
+namespace Linker {
+	enum OutputType {
+		EXECUTABLE,
+		SHARED_LIBRARY
+	};
+
+	struct Options {
+		OutputType outputType = EXECUTABLE;
+		std::string outputFilename = "a.out";
+		// Compiler driver used to link. Found on the PATH if not absolute.
+		std::string driver = "cc";
+		// Extra libraries and flags passed to the driver after the object.
+		std::vector<std::string> arguments;
+	};
+
+	bool link(llvm::StringRef object, Options options);
+}
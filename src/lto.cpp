@@ -0,0 +1,76 @@
+#include "lto.hpp"
+#include <map>
+#include <memory>
+#include <llvm/LTO/Config.h>
+#include <llvm/LTO/LTO.h>
+#include <llvm/Support/Caching.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/raw_ostream.h>
+#include "backend.hpp"
+
+namespace Lto {
+	using namespace llvm;
+
+	bool link(std::vector<std::string> files, Options options) {
+		Backend::initializeTargets();
+		options.exports.insert("main");
+
+		lto::Config config;
+		config.CPU = "generic";
+		lto::LTO lto(std::move(config), lto::createInProcessThinBackend(heavyweight_hardware_concurrency(options.jobs)));
+
+		// Input files reference their buffers, so the buffers must outlive the link.
+		std::vector<std::unique_ptr<MemoryBuffer>> buffers;
+		std::set<std::string> defined;
+		for (auto &file: files) {
+			auto buffer = MemoryBuffer::getFile(file);
+			if (!buffer) {
+				errs() << "Could not open file " << file << ": " << buffer.getError().message() << "\n";
+				return false;
+			}
+			auto input = lto::InputFile::create((*buffer)->getMemBufferRef());
+			if (!input) {
+				errs() << file << ": " << toString(input.takeError()) << "\n";
+				return false;
+			}
+			buffers.push_back(std::move(*buffer));
+
+			// Every module is IR, so the first definition of a symbol prevails and only exports are visible to
+			// native code. Everything else may be internalized and dead-stripped.
+			std::vector<lto::SymbolResolution> resolutions;
+			for (auto &symbol: (*input)->symbols()) {
+				lto::SymbolResolution resolution;
+				std::string name = symbol.getName().str();
+				if (!symbol.isUndefined()) {
+					resolution.Prevailing = defined.insert(name).second;
+					resolution.FinalDefinitionInLinkageUnit = true;
+				}
+				resolution.VisibleToRegularObj = options.exports.count(name) != 0;
+				resolutions.push_back(resolution);
+			}
+			if (auto error = lto.add(std::move(*input), resolutions)) {
+				errs() << file << ": " << toString(std::move(error)) << "\n";
+				return false;
+			}
+		}
+
+		// Each module becomes its own object, named by task number.
+		auto addStream = [&](unsigned int task) -> Expected<std::unique_ptr<CachedFileStream>> {
+			std::string filename = options.outputFilename + "." + std::to_string(task) + ".o";
+			std::error_code errorCode;
+			auto stream = std::make_unique<raw_fd_ostream>(filename, errorCode, sys::fs::OF_None);
+			if (errorCode) {
+				return errorCodeToError(errorCode);
+			}
+			return std::make_unique<CachedFileStream>(std::move(stream));
+		};
+		if (auto error = lto.run(addStream)) {
+			errs() << toString(std::move(error)) << "\n";
+			return false;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <vector>
+
+namespace Lto {
+	struct Options {
+		// Zero means one job per core.
+		unsigned int jobs = 0;
+		// Symbols that must survive internalization. `main` is always exported.
+		std::set<std::string> exports;
+		// Each module is written to `<outputFilename>.<task>.o`.
+		std::string outputFilename = "output.lto";
+	};
+
+	bool link(std::vector<std::string> files, Options options);
+}
@@ -1,4 +1,8 @@
 #include "parser.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <fstream>
@@ -6,14 +10,58 @@
 #include "macros.hpp"
 #include "types.hpp"
 #include "backend.hpp"
+#include "lto.hpp"
+#include <sys/resource.h>
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
 
 int main(int argc, char *argv[]) {
 	// Read file.
 	std::string source;
+	Backend::Options backendOptions;
+	bool quiet = false;
+	bool stats = false;
+	bool costReport = false;
+	bool parallelParse = false;
+	unsigned int parseThreads = 0;
+	std::size_t costReportLength = 20;
+	auto compileStart = std::chrono::steady_clock::now();
 	{
 		using namespace CliOptions;
 		auto options = parse(argc, argv);
 		auto version = option_get(options, "version");
+		if (option_get(options, "thinlto-link").valid) {
+			// Link mode: every positional argument is a bitcode file.
+			std::vector<std::string> files;
+			for (auto &option: options) {
+				if (option.valid && (option.key == "") && (option.value != "")) {
+					files.push_back(option.value);
+				}
+			}
+			Lto::Options ltoOptions;
+			auto jobs = option_get(options, "jobs");
+			if (jobs.valid) {
+				ltoOptions.jobs = std::stoul(jobs.value);
+			}
+			auto exports = option_get(options, "export");
+			if (exports.valid) {
+				std::stringstream exportStream(exports.value);
+				std::string name;
+				while (std::getline(exportStream, name, ',')) {
+					ltoOptions.exports.insert(name);
+				}
+			}
+			auto output = option_get(options, "output");
+			if (!output.valid) {
+				output = option_get(options, "o");
+			}
+			if (output.valid) {
+				ltoOptions.outputFilename = output.value;
+			}
+			return Lto::link(files, ltoOptions) ? 0 : 1;
+		}
 		auto file = option_get(options, "file");
 		if (!file.valid) {
 			file = option_get(options, "f");
@@ -22,7 +70,98 @@ int main(int argc, char *argv[]) {
 			std::cout << "No file given." << std::endl;
 			return 1;
 		}
-		std::cout << "file " << file.value << std::endl;
+		quiet = option_get(options, "quiet").valid;
+		stats = option_get(options, "stats").valid;
+		backendOptions.quiet = quiet;
+		auto parallelParseOption = option_get(options, "parallel-parse");
+		if (parallelParseOption.valid) {
+			parallelParse = true;
+			if (parallelParseOption.value != "") {
+				parseThreads = std::stoul(parallelParseOption.value);
+			}
+		}
+		auto costReportOption = option_get(options, "cost-report");
+		if (costReportOption.valid) {
+			costReport = true;
+			backendOptions.costReport = true;
+			if (costReportOption.value != "") {
+				costReportLength = std::stoul(costReportOption.value);
+			}
+		}
+		if (!quiet) {
+			std::cout << "file " << file.value << std::endl;
+		}
+		backendOptions.sourceFilename = file.value;
+		if (option_get(options, "emit-bc").valid) {
+			backendOptions.emitType = Backend::BITCODE;
+		}
+		if (option_get(options, "thinlto").valid) {
+			backendOptions.emitType = Backend::THINLTO_BITCODE;
+		}
+		auto target = option_get(options, "target");
+		if (target.valid) {
+			backendOptions.targetTriple = target.value;
+		}
+		auto optimization = option_get(options, "O");
+		if (optimization.valid) {
+			if (optimization.value == "s") {
+				backendOptions.optimizationGoal = Backend::SIZE;
+			}
+			else if (optimization.value == "z") {
+				backendOptions.optimizationGoal = Backend::MIN_SIZE;
+			}
+		}
+		backendOptions.freestanding = option_get(options, "freestanding").valid;
+		backendOptions.functionSections = option_get(options, "function-sections").valid;
+		auto textSection = option_get(options, "text-section");
+		if (textSection.valid) {
+			backendOptions.textSection = textSection.value;
+		}
+		backendOptions.longCalls = option_get(options, "long-calls").valid;
+		auto cpu = option_get(options, "cpu");
+		if (cpu.valid) {
+			backendOptions.cpu = cpu.value;
+		}
+		auto features = option_get(options, "features");
+		if (features.valid) {
+			backendOptions.features = features.value;
+		}
+		auto profileGenerate = option_get(options, "profile-generate");
+		if (profileGenerate.valid) {
+			backendOptions.profileGenerate = true;
+			if (profileGenerate.value != "") {
+				backendOptions.profileGenerateFile = profileGenerate.value;
+			}
+		}
+		auto profileUse = option_get(options, "profile-use");
+		if (profileUse.valid) {
+			backendOptions.profileUse = profileUse.value;
+		}
+		if (option_get(options, "g").valid) {
+			backendOptions.debugInfo = true;
+		}
+		auto output = option_get(options, "output");
+		if (!output.valid) {
+			output = option_get(options, "o");
+		}
+		if (output.valid) {
+			backendOptions.outputFilename = output.value;
+			backendOptions.linkerOptions.outputFilename = output.value;
+		}
+		auto shared = option_get(options, "shared");
+		if (option_get(options, "link").valid || shared.valid) {
+			backendOptions.link = true;
+			if (shared.valid) {
+				backendOptions.linkerOptions.outputType = Linker::SHARED_LIBRARY;
+			}
+			auto linker = option_get(options, "linker");
+			if (linker.valid) {
+				backendOptions.linkerOptions.driver = linker.value;
+			}
+			// Programs may call into the runtime, so it is always available to the link.
+			backendOptions.linkerOptions.arguments.push_back(BILBY_RUNTIME_LIBRARY);
+			backendOptions.linkerOptions.arguments.push_back("-pthread");
+		}
 
 		std::ifstream fileStream(file.value);
 		std::stringstream fileStringStream;
@@ -30,9 +169,10 @@ int main(int argc, char *argv[]) {
 		source = fileStringStream.str();
 	}
 	Parser::Form form;
+	auto phaseStart = std::chrono::steady_clock::now();
 	{
 		using namespace Parser;
-		auto status = parse(ParserStream(source));
+		auto status = parallelParse ? parseParallel(source, parseThreads) : parse(ParserStream(source));
 		if (status.valid != SUCCESS) {
 			std::cout << "ERROR" << std::endl;
 			for (auto &error: status.errors) {
@@ -41,9 +181,14 @@ int main(int argc, char *argv[]) {
 			return 1;
 		}
 		form = status.form;
-		std::cout << status.prettyPrint() << std::endl;
+		if (!quiet) {
+			std::cout << status.prettyPrint() << std::endl;
+		}
+	}
+	double parseSeconds = secondsSince(phaseStart);
+	if (!quiet) {
+		std::cout << form.toString() << std::endl;
 	}
-	std::cout << form.toString() << std::endl;
 	{
 		using namespace Macros;
 		expandAll();
@@ -52,10 +197,57 @@ int main(int argc, char *argv[]) {
 		using namespace Types;
 		resolveAll(form);
 	}
+	Backend::Statistics statistics;
 	{
 		using namespace Backend;
-		generate(form);
+		statistics = generate(form, backendOptions);
+	}
+	if (stats) {
+		// One "key value" pair per line so that scripts can pick out what they need.
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		std::cout << "source-bytes " << source.size() << std::endl;
+		std::cout << "functions " << statistics.functions << std::endl;
+		std::cout << "time-parse " << parseSeconds << std::endl;
+		std::cout << "time-lower " << statistics.lowerSeconds << std::endl;
+		std::cout << "time-optimize " << statistics.optimizeSeconds << std::endl;
+		std::cout << "time-emit " << statistics.emitSeconds << std::endl;
+		std::cout << "time-total " << secondsSince(compileStart) << std::endl;
+		std::cout << "instructions-lowered " << statistics.instructionsBeforeOptimization << std::endl;
+		std::cout << "instructions-optimized " << statistics.instructionsAfterOptimization << std::endl;
+		std::cout << "peak-rss-kb " << usage.ru_maxrss << std::endl;
+	}
+	if (costReport) {
+		// The most expensive functions to optimize first. Optimization dominates the compile time of large inputs.
+		// Times are compared at the printed precision, and ties, which are common for small functions, go to the
+		// function with more IR.
+		auto costs = statistics.functionCosts;
+		std::stable_sort(costs.begin(), costs.end(), [](auto &a, auto &b) {
+			auto aMicroseconds = std::llround(a.optimizeSeconds * 1e6);
+			auto bMicroseconds = std::llround(b.optimizeSeconds * 1e6);
+			if (aMicroseconds != bMicroseconds) {
+				return aMicroseconds > bMicroseconds;
+			}
+			return a.instructionsBeforeOptimization > b.instructionsBeforeOptimization;
+		});
+		if (costs.size() > costReportLength) {
+			costs.resize(costReportLength);
+		}
+		std::cout << std::setw(12) << "optimize-ms"
+		          << std::setw(10) << "ast-nodes"
+		          << std::setw(12) << "ir-lowered"
+		          << std::setw(14) << "ir-optimized"
+		          << std::setw(12) << "code-bytes"
+		          << "  function" << std::endl;
+		for (auto &cost: costs) {
+			std::cout << std::setw(12) << std::fixed << std::setprecision(3) << (cost.optimizeSeconds * 1000)
+			          << std::setw(10) << (cost.synthetic ? std::string("-") : std::to_string(cost.astNodes))
+			          << std::setw(12) << cost.instructionsBeforeOptimization
+			          << std::setw(14) << cost.instructionsAfterOptimization
+			          << std::setw(12) << cost.machineCodeBytes
+			          << "  " << cost.name << std::endl;
+		}
 	}
 
-	return 0;
+	return statistics.written ? 0 : 1;
 }
@@ -1,8 +1,10 @@
 #include "parser.hpp"
+#include <algorithm>
 #include <cctype>
 #include <cstddef>
 #include <cstdint>
 #include <iostream>
+#include <llvm/Support/ThreadPool.h>
 
 /* Provides a function scope instead of a normal scope. This means you can return a value from it. */
 #define SCOPE(SCOPE_body) (([&]() { SCOPE_body; })())
@@ -189,6 +191,8 @@ namespace Parser {
 
 	ParserStatus parseCompoundForm(ParserStream &source) {
 		ParserStatus status;
+		auto line = source.line();
+		auto column = source.column();
 		auto parsers = {parseInt,
 		                parseIdentifier,
 		                parseForm};
@@ -199,6 +203,8 @@ namespace Parser {
 			}
 		}
 		if (status.valid == SUCCESS) {
+			status.form.line = line;
+			status.form.column = column;
 			// Check for type annotations.
 			status.valid = SCOPE(
 			                     ParserStream source2{source};
@@ -267,10 +273,104 @@ namespace Parser {
 			source.consume();
 			status.form.forms = forms;
 			status.form.type = FormType::FORM;
+			status.form.line = 1;
+			status.form.column = 1;
 		}
 		else {
 			delete forms;
 		}
 		return status;
 	}
+
+	/* Top-level forms don't depend on each other, so the source is cut into pieces that each hold whole top-level
+	   forms, and the pieces are parsed at the same time. A cheap scan finds where the top-level forms start. The
+	   grammar has no strings or comments, so only parentheses need to be tracked. If the scan or any piece fails,
+	   the whole source is parsed again sequentially, so errors are reported exactly as `parse` would report them. */
+	ParserStatus parseParallel(const std::string &source, unsigned int threads) {
+		struct Cut {
+			std::ptrdiff_t index;
+			std::ptrdiff_t lineNumber;
+			std::ptrdiff_t columnNumber;
+		};
+		std::vector<Cut> cuts = {{0, 0, 0}};
+		{
+			std::ptrdiff_t depth = 0;
+			std::ptrdiff_t lineNumber = 0;
+			std::ptrdiff_t columnNumber = 0;
+			// A form after `::` is a type annotation, which belongs to the form before it.
+			char previous = ' ';
+			for (std::ptrdiff_t i = 0; i < source.length(); i++) {
+				char c = source[i];
+				if (c == '(') {
+					if ((depth == 0) && (previous != ':') && (i != 0)) {
+						cuts.push_back({i, lineNumber, columnNumber});
+					}
+					depth++;
+				}
+				else if (c == ')') {
+					depth--;
+					if (depth < 0) {
+						break;
+					}
+				}
+				if (!std::isspace(c)) {
+					previous = c;
+				}
+				if (c == '\n') {
+					lineNumber++;
+					columnNumber = 0;
+				}
+				else {
+					columnNumber++;
+				}
+			}
+			if (depth != 0) {
+				return parse(ParserStream(source));
+			}
+		}
+
+		llvm::ThreadPool pool(llvm::hardware_concurrency(threads));
+		// Several pieces per thread so that one slow piece doesn't hold up the rest.
+		std::size_t pieceCount = std::min<std::size_t>(cuts.size(), pool.getThreadCount() * 4);
+		std::size_t pieceLength = (source.length() / pieceCount) + 1;
+		std::vector<Cut> pieces;
+		for (auto &cut: cuts) {
+			if (pieces.empty() || (cut.index - pieces.back().index >= pieceLength)) {
+				pieces.push_back(cut);
+			}
+		}
+		std::vector<ParserStatus> statuses(pieces.size());
+		for (std::size_t i = 0; i < pieces.size(); i++) {
+			pool.async([&, i]() {
+				std::ptrdiff_t end = (i + 1 < pieces.size()) ? pieces[i + 1].index : source.length();
+				std::string piece = source.substr(pieces[i].index, end - pieces[i].index);
+				statuses[i] = parse(ParserStream(piece, pieces[i].lineNumber, pieces[i].columnNumber));
+			});
+		}
+		pool.wait();
+
+		ParserStatus status;
+		Forms *forms = new Forms();
+		{
+			Form toplevel{};
+			toplevel.type = IDENTIFIER;
+			toplevel.identifier = new std::string("toplevel");
+			forms->push_back(toplevel);
+		}
+		for (auto &pieceStatus: statuses) {
+			if (pieceStatus.valid != SUCCESS) {
+				delete forms;
+				return parse(ParserStream(source));
+			}
+			// Skip each piece's own `toplevel`.
+			forms->insert(forms->end(), pieceStatus.form.forms->begin() + 1, pieceStatus.form.forms->end());
+			delete pieceStatus.form.forms;
+		}
+		status.valid = SUCCESS;
+		status.form.forms = forms;
+		status.form.type = FormType::FORM;
+		status.form.line = 1;
+		status.form.column = 1;
+		return status;
+	}
 }
@@ -10,19 +10,32 @@
 namespace Parser {
 
 	class ParserStream {
-		std::string string = "";
+		// Shared by every stream derived from the same source. Copying it would make lookahead quadratic.
+		const std::string &string;
 		std::ptrdiff_t index = 0;
 		std::ptrdiff_t &parent_index;
 		std::ptrdiff_t startLineNumber = 0;
 		std::ptrdiff_t startColumnNumber = 0;
 		std::ptrdiff_t lineNumber = 0;
 		std::ptrdiff_t columnNumber = 0;
+		std::ptrdiff_t &parentLineNumber;
+		std::ptrdiff_t &parentColumnNumber;
 	public:
-		ParserStream(std::string &string) : parent_index(index) {
-			this->string = string;
+		ParserStream(const std::string &string)
+			: string(string), parent_index(index), parentLineNumber(lineNumber), parentColumnNumber(columnNumber) {}
+		// For a piece of a larger source. The zero-based line and column are those of the piece's first character.
+		ParserStream(const std::string &string, std::ptrdiff_t lineNumber, std::ptrdiff_t columnNumber)
+			: ParserStream(string) {
+			this->lineNumber = lineNumber;
+			this->columnNumber = columnNumber;
+			startLineNumber = lineNumber;
+			startColumnNumber = columnNumber;
 		}
-		ParserStream(ParserStream &stream) : parent_index(stream.index) {
-			string = stream.string;
+		ParserStream(ParserStream &stream)
+			: string(stream.string),
+			  parent_index(stream.index),
+			  parentLineNumber(stream.lineNumber),
+			  parentColumnNumber(stream.columnNumber) {
 			index = stream.index;
 			lineNumber = stream.lineNumber;
 			columnNumber = stream.columnNumber;
@@ -53,9 +66,18 @@ namespace Parser {
 		}
 		void consume() {
 			parent_index = index;
+			parentLineNumber = lineNumber;
+			parentColumnNumber = columnNumber;
 			startLineNumber = lineNumber;
 			startColumnNumber = columnNumber;
 		}
+		// One-based position of the next character.
+		std::ptrdiff_t line() {
+			return lineNumber + 1;
+		}
+		std::ptrdiff_t column() {
+			return columnNumber + 1;
+		}
 		std::string coordsToString() {
 			std::string s = "";
 			s += std::to_string(startLineNumber + 1);
@@ -74,6 +96,9 @@ namespace Parser {
 	struct Form {
 		FormType type;
 		Form *typeAnnotation = nullptr;
+		// One-based source position of the first character, or 0 if the form was not read from source.
+		std::ptrdiff_t line = 0;
+		std::ptrdiff_t column = 0;
 		union {
 			uint64_t integer;
 			std::vector<Form> *forms;
@@ -201,4 +226,6 @@ namespace Parser {
 	};
 
 	ParserStatus parse(ParserStream source);
+	// Same result as `parse`, but top-level forms are parsed on up to `threads` threads. 0 means one per core.
+	ParserStatus parseParallel(const std::string &source, unsigned int threads);
 }